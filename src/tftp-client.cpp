@@ -5,7 +5,9 @@
 
 int main(int argc, char *argv[]) {
   ClientArgs args = ArgParser::parseClientArgs(argv, argc);
-  Options::map_t opts = Options::create(512, 10, 0);
+  Options::Set opts;
+  opts.setDefault(Options::Key::TIMEOUT, 10);
+  if (args.mWindowSize > 0) opts.set(Options::Key::WINDOWSIZE, args.mWindowSize);
 
   TFTP::Client client{args, opts};
 
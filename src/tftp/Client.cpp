@@ -16,7 +16,10 @@ void TFTP::Client::transmit() {
   }
 }
 
-TFTP::Client::Client(const ClientArgs &args, Options::map_t opts) : mOptions(std::move(opts)) {
+TFTP::Client::Client(const ClientArgs &args, Options::Set opts) : mOptions(std::move(opts)),
+                                                                     mRtt(std::min(mOptions.getTimeout(), RttEstimator::INITIAL_TIMEOUT),
+                                                                          mOptions.getTimeout()) {
+  mIo = IoBackend::create(args.mUring, false);
   mSocketFd = socket(AF_INET, SOCK_DGRAM, 0);
 
   mClientAddress = {};
@@ -43,6 +46,7 @@ TFTP::Client::Client(const ClientArgs &args, Options::map_t opts) : mOptions(std
   mTransmissionMode = "octet";
 
   mBlockNumber = 1;
+  mWindowSize = 1;
   mDestFilePath = args.mDestFilePath;
   mState = State::INIT;
   mErrorPacket = std::nullopt;
@@ -61,17 +65,16 @@ TFTP::Client::Client(const ClientArgs &args, Options::map_t opts) : mOptions(std
 }
 
 void TFTP::Client::sendPacket(const Packet &packet) {
-  std::vector<uint8_t> data = packet.serialize();
-  sendto(mSocketFd, data.data(), data.size(), 0, (struct sockaddr *) &mServerAddress,
-         sizeof(mServerAddress));
+  packet.serializeInto(mIo->queue(mSocketFd, packet.serializedSize(), {}, mServerAddress));
 }
 
-std::unique_ptr<TFTP::Packet> TFTP::Client::receivePacket() {
-  std::vector<uint8_t> buffer(std::max(Options::get("blksize", mOptions), 512l) + 4);
+TFTP::PacketView TFTP::Client::receivePacket(RttEstimator::duration timeout) {
+  // grows once blksize is negotiated, it is never reallocated afterwards
+  mReceiveBuffer.resize(std::max(mOptions.get(Options::Key::BLKSIZE), 512l) + 4);
   sockaddr_in from_address = {};
-  socklen_t from_length = sizeof(from_address);
-  ssize_t received = recvfrom(mSocketFd, buffer.data(), buffer.size(), 0, (struct sockaddr *) &from_address,
-                              &from_length);
+  auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(timeout).count();
+  ssize_t received = mIo->receive(mSocketFd, mReceiveBuffer.data(), mReceiveBuffer.size(), from_address,
+                                  static_cast<int>(milliseconds));
 
   if (received <= 0) {
     if (errno == EAGAIN || errno == EWOULDBLOCK) {
@@ -81,16 +84,9 @@ std::unique_ptr<TFTP::Packet> TFTP::Client::receivePacket() {
     }
   }
 
-  buffer.resize(received);
-  std::unique_ptr<Packet> packet;
-  try {
-    packet = Packet::deserialize(buffer);
-  } catch (TFTP::PacketFormatException &e) {
-    throw e;
-  }
+  PacketView packet = parsePacket(std::span<const uint8_t>(mReceiveBuffer.data(), received));
 
-  std::cerr << packet->formatPacket(inet_ntoa(from_address.sin_addr), ntohs(from_address.sin_port),
-                                    ntohs(mClientPort));
+  printPacket(std::cerr, packet, inet_ntoa(from_address.sin_addr), ntohs(from_address.sin_port), ntohs(mClientPort));
 
   if (mState == State::SENT_RRQ || mState == State::SENT_WRQ) {
     mServerAddress.sin_port = from_address.sin_port;
@@ -99,12 +95,27 @@ std::unique_ptr<TFTP::Packet> TFTP::Client::receivePacket() {
   }
 
   if (mServerAddress.sin_port != from_address.sin_port || mServerAddress.sin_addr.s_addr != from_address.sin_addr.s_addr) {
+    // e.g. connection created by retransmitted request, the exchange itself goes on
+    mIo->send(mSocketFd, ErrorPacket{5, "Unknown transfer ID"}.serialize(), from_address);
     throw TFTP::InvalidTIDException();
   }
 
   return packet;
 }
 
+bool TFTP::Client::applyOptions(const OACKView &oack_packet) {
+  auto acknowledged = oack_packet.getOptions();
+  // RFC 7440, server may only lower the requested window, unrequested window stays at the default of 1
+  if (acknowledged.isSet(Options::Key::WINDOWSIZE) &&
+      acknowledged.get(Options::Key::WINDOWSIZE) > mOptions.get(Options::Key::WINDOWSIZE)) {
+    return false;
+  }
+  mOptions.update(acknowledged);
+
+  if (mOptions.isSet(Options::Key::WINDOWSIZE)) mWindowSize = mOptions.get(Options::Key::WINDOWSIZE);
+  return true;
+}
+
 void TFTP::Client::requestRead() {
   std::unique_ptr<IOutputWrapper> outputFile;
   if (mTransmissionMode == "octet") {
@@ -114,40 +125,63 @@ void TFTP::Client::requestRead() {
   }
 
   mState = State::SENT_RRQ;
-  Options::map_t opts = {};
-  mLastPacket = std::make_unique<RRQPacket>(mSrcFilePath, mTransmissionMode, opts);
+  mWindow.push_back(std::make_unique<RRQPacket>(mSrcFilePath, mTransmissionMode, mOptions));
+
+  bool toSend = true;
+  long received = 0;
 
   while (mState != State::ERROR && mState != State::FINAL_ACK && runningClient) {
 
-    auto packet = exchangePackets(*mLastPacket, true);
+    auto packet = exchangePackets(toSend);
     if (!packet) {
       break;
     }
-    auto data_packet = dynamic_cast<DataPacket *>(packet.get());
-    auto error_packet = dynamic_cast<ErrorPacket *>(packet.get());
-    if (error_packet) {
+    auto data_packet = std::get_if<DataView>(&*packet);
+    auto oack_packet = std::get_if<OACKView>(&*packet);
+    if (std::holds_alternative<ErrorView>(*packet)) {
       mState = State::ERROR;
       break;
     }
 
+    // OACK is only valid as response to the request itself
+    if (oack_packet && dynamic_cast<RRQPacket *>(mWindow.front().get())) {
+      if (!applyOptions(*oack_packet)) {
+        mState = State::ERROR;
+        mErrorPacket = std::optional(ErrorPacket{8, "Option negotiation failed"});
+        break;
+      }
+      mWindow.front() = std::make_unique<ACKPacket>(0);
+      toSend = true;
+      continue;
+    }
+
     if (!data_packet) {
       mState = State::ERROR;
       mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
       break;
-    } else if (data_packet->getBlockNumber() == mBlockNumber) {
-      outputFile->write(data_packet->getData());
-      if (data_packet->getData().size() < Options::get("blksize", mOptions)) {
+    }
+
+    auto ahead = static_cast<int16_t>(data_packet->mBlockNumber - mBlockNumber);
+    if (ahead == 0) {
+      outputFile->write(data_packet->mData);
+      if (data_packet->mData.size() < mOptions.get(Options::Key::BLKSIZE)) {
         mState = State::FINAL_ACK;
       }
       // Increment block number only after it is valid packet
       mBlockNumber++;
-      mLastPacket = std::make_unique<ACKPacket>(mBlockNumber - 1);
-    } else if (data_packet->getBlockNumber() > mBlockNumber) {
+      // ACK is sent once per window, or on timeout to make the server rewind
+      mWindow.front() = std::make_unique<ACKPacket>(mBlockNumber - 1);
+      toSend = ++received == mWindowSize;
+      if (toSend) received = 0;
+    } else if (ahead >= mWindowSize) {
       mState = State::ERROR;
       mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
       break;
-    } else if (data_packet->getBlockNumber() < mBlockNumber) {
-      mLastPacket = std::make_unique<ACKPacket>(mBlockNumber - 1);
+    } else {
+      // gap in the window or duplicate block, server rewinds to the block after our ACK
+      mWindow.front() = std::make_unique<ACKPacket>(mBlockNumber - 1);
+      toSend = true;
+      received = 0;
     }
   }
 
@@ -167,49 +201,69 @@ void TFTP::Client::requestWrite() {
     inputFile = std::make_unique<NetAscii::InputStdin>();
   }
   mState = State::SENT_WRQ;
-  Options::map_t opts = {};
-  mLastPacket = std::make_unique<WRQPacket>(mDestFilePath, mTransmissionMode, opts);
+  // WRQ takes place of block 0 in the window
+  mWindow.push_back(std::make_unique<WRQPacket>(mDestFilePath, mTransmissionMode, mOptions));
   mBlockNumber = 0;
 
   bool toSend = true;
+  bool finalRead = false;
 
   while (mState != State::ERROR && mState != State::FINAL_ACK && runningClient) {
-    auto packet = exchangePackets(*mLastPacket, toSend);
+    auto packet = exchangePackets(toSend);
 
     if (!packet) {
       break;
     }
 
-    auto ack_packet = dynamic_cast<ACKPacket *>(packet.get());
-    auto error_packet = dynamic_cast<ErrorPacket *>(packet.get());
-    if (error_packet) {
+    auto ack_packet = std::get_if<ACKView>(&*packet);
+    auto oack_packet = std::get_if<OACKView>(&*packet);
+    if (std::holds_alternative<ErrorView>(*packet)) {
       mState = State::ERROR;
       break;
     }
 
-    if (!ack_packet) {
+    uint16_t block_number;
+    if (oack_packet && dynamic_cast<WRQPacket *>(mWindow.front().get())) {
+      // OACK acknowledges the request same as ACK 0
+      if (!applyOptions(*oack_packet)) {
+        mState = State::ERROR;
+        mErrorPacket = std::optional(ErrorPacket{8, "Option negotiation failed"});
+        break;
+      }
+      block_number = 0;
+    } else if (ack_packet) {
+      block_number = ack_packet->mBlockNumber;
+    } else {
       mState = State::ERROR;
       mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
       break;
-    } else if (ack_packet->getBlockNumber() == mBlockNumber) {
+    }
+
+    // ACK is cumulative, ACK of a block inside the window rewinds the window to the next block
+    uint16_t acked = block_number - mBlockNumber + 1;
+    uint16_t last_sent = mBlockNumber + mWindow.size() - 1;
+    if (acked >= 1 && acked <= mWindow.size()) {
+      mWindow.erase(mWindow.begin(), mWindow.begin() + acked);
+      mBlockNumber += acked;
 
-      auto sent_packet = dynamic_cast<DataPacket *>(mLastPacket.get());
-      if (sent_packet && sent_packet->getData().size() < Options::get("blksize", mOptions)) {
+      if (mWindow.empty() && finalRead) {
         mState = State::FINAL_ACK;
         break;
       }
 
-      mBlockNumber++;
+      while (!finalRead && mWindow.size() < mWindowSize) {
+        std::vector<uint8_t> data(mOptions.get(Options::Key::BLKSIZE));
+        inputFile->read(reinterpret_cast<char *>(data.data()), data.size());
+        data.resize(inputFile->gcount());
+        finalRead = data.size() < mOptions.get(Options::Key::BLKSIZE);
+        mWindow.push_back(std::make_unique<DataPacket>(mBlockNumber + mWindow.size(), data));
+      }
       toSend = true;
-      std::vector<uint8_t> data(Options::get("blksize", mOptions));
-      inputFile->read(reinterpret_cast<char *>(data.data()), data.size());
-      data.resize(std::cin.gcount());
-      mLastPacket = std::make_unique<DataPacket>(mBlockNumber, data);
-    } else if (ack_packet->getBlockNumber() > mBlockNumber) {
+    } else if (static_cast<int16_t>(block_number - last_sent) > 0) {
       mState = State::ERROR;
       mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
       break;
-    } else if (ack_packet->getBlockNumber() < mBlockNumber) {
+    } else {
       toSend = false;
     }
   }
@@ -219,19 +273,39 @@ void TFTP::Client::requestWrite() {
   }
 }
 
-std::unique_ptr<TFTP::Packet> TFTP::Client::exchangePackets(const Packet &packet, bool send) {
-  if (send) sendPacket(packet);
+std::optional<TFTP::PacketView> TFTP::Client::exchangePackets(bool send) {
+  auto sent_at = std::chrono::steady_clock::now();
+  auto deadline = sent_at + mOptions.getTimeout() * MAX_RETRIES;
+  bool retransmitted = !send;
+  if (send) {
+    for (auto &packet: mWindow) sendPacket(*packet);
+  }
+
   try {
-    return receivePacket();
+    while (runningClient) {
+      try {
+        auto response = receivePacket(mRtt.getTimeout());
+        // response to retransmitted packet can belong to any of the copies
+        if (!retransmitted) {
+          mRtt.sample(std::chrono::duration_cast<RttEstimator::duration>(std::chrono::steady_clock::now() - sent_at));
+        }
+        return response;
+      } catch (TFTP::TimeoutException &e) {
+        if (std::chrono::steady_clock::now() >= deadline) throw;
+        mRtt.backoff();
+        retransmitted = true;
+        for (auto &packet: mWindow) sendPacket(*packet);
+      } catch (TFTP::InvalidTIDException &e) {
+        // stray packet was already answered, keep waiting for the server
+      }
+    }
   } catch (TFTP::TimeoutException &e) {
     mErrorPacket = std::optional(ErrorPacket{0, "Timeout"});
-  } catch (TFTP::InvalidTIDException &e) {
-    mErrorPacket = std::optional(ErrorPacket{5, "Unknown transfer ID"});
   } catch (TFTP::UndefinedException &e) {
     mErrorPacket = std::optional(ErrorPacket{0, "Undefined error"});
   } catch (TFTP::PacketFormatException &e) {
     mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
   }
   mState = State::ERROR;
-  return nullptr;
+  return std::nullopt;
 }
@@ -5,6 +5,7 @@
 
 #include <arpa/inet.h>
 #include <csignal>
+#include <deque>
 #include <netinet/in.h>
 #include <sys/socket.h>
 
@@ -12,8 +13,11 @@
 #include "../utils/IInputWrapper.h"
 #include "../utils/IOutputWrapper.h"
 #include "../utils/Options.h"
+#include "../utils/RttEstimator.h"
 #include "../utils/utils.h"
+#include "IoBackend.h"
 #include "Packet.h"
+#include "PacketView.h"
 #include "common.h"
 
 namespace TFTP {
@@ -21,6 +25,7 @@ namespace TFTP {
    * @brief Client class
    */
   class Client {
+    std::unique_ptr<IoBackend> mIo;
     int mSocketFd;
     sockaddr_in mServerAddress;
     sockaddr_in mClientAddress;
@@ -30,15 +35,23 @@ namespace TFTP {
     State mState;
     std::string mTransmissionMode;
 
+    // download: next expected block, upload: block number of the first packet in window
     int mBlockNumber;
+    // windowsize acknowledged by the server
+    long mWindowSize;
     Mode mMode;
     std::string mSrcFilePath;
     std::string mDestFilePath;
     std::optional<ErrorPacket> mErrorPacket;
 
-    std::unique_ptr<Packet> mLastPacket;
+    // packets waiting for acknowledgement, retransmitted together
+    std::deque<std::unique_ptr<Packet>> mWindow;
 
-    Options::map_t mOptions;
+    Options::Set mOptions;
+    RttEstimator mRtt;
+
+    // holds the last received datagram, packet views point into it
+    std::vector<uint8_t> mReceiveBuffer;
 
     /**
      * @brief Sends packet to the server
@@ -47,21 +60,30 @@ namespace TFTP {
     void sendPacket(const Packet &packet);
 
     /**
-     * @brief Receives packet from the server
-     * @return unique pointer to the packet received
+     * @brief Receives packet from the server, packet from unknown source is answered by error
+     * and InvalidTIDException is thrown
+     * @param timeout time to wait for the packet, TimeoutException is thrown when it expires
+     * @return view of the packet received, valid until the next receive
      */
-    std::unique_ptr<Packet> receivePacket();
+    PacketView receivePacket(RttEstimator::duration timeout);
+
+    /**
+     * @brief Applies options acknowledged by the server
+     * @param oack_packet OACK received from the server
+     * @return false if the server acknowledged larger window than requested, options are not applied then
+     */
+    bool applyOptions(const OACKView &oack_packet);
 
   public:
     /**
      * @brief Client constructor
      * @param args structure holding arguments passed to the program
-     * @param opts options to be used in rrq/wrq packets
+     * @param opts options to be used, present ones are requested in rrq/wrq packets
      */
-    explicit Client(const ClientArgs &args, Options::map_t opts);
+    explicit Client(const ClientArgs &args, Options::Set opts);
 
     ~Client() {
-      close(mSocketFd);
+      mIo->close(mSocketFd);
     }
 
     /**
@@ -80,12 +102,12 @@ namespace TFTP {
     void requestWrite();
 
     /**
-     * @brief sends packet to the server if send is true, and then waits for response
-     * @param packet packet to be sent
-     * @param send if true, packet is sent to the server
-     * @return unique pointer to the packet received, null if error occured
+     * @brief sends packets in window to the server if send is true, and then waits for response,
+     * the window is retransmitted with backed off timeout until response arrives or the exchange times out
+     * @param send if true, window is sent to the server
+     * @return view of the packet received valid until the next exchange, nullopt if error occured
      */
-    std::unique_ptr<Packet> exchangePackets(const Packet &packet, bool send);
+    std::optional<PacketView> exchangePackets(bool send);
   };
 }// namespace TFTP
 
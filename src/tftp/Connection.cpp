@@ -2,25 +2,44 @@
 
 #include "Connection.h"
 
-void ConnectionSigUsrHandler(int signum) {
-  return;
-}
-
-TFTP::Connection::Connection(std::string file, Options::map_t options, sockaddr_in client_address, std::string transmission_mode) {
+#include <sys/stat.h>
+
+TFTP::Connection::Connection(std::string file, Options::Set options, sockaddr_in client_address, std::string transmission_mode,
+                             IoBackend &io, TimerWheel &timers, BlockCache &cache, BufferPool &buffers,
+                             GroupCommit &commit, int wake_fd, FileIoPool &file_io) : mIo(io),
+                                                                  mTimers(timers),
+                                                                  mRetransmitTimer([this] { handleTimeout(); }),
+                                                                  mIdleTimer([this] { fail(ErrorPacket(0, "Timeout")); }),
+                                                                  mRtt(std::min(options.getTimeout(), RttEstimator::INITIAL_TIMEOUT),
+                                                                       options.getTimeout()),
+                                                                  mCongestion(std::max(options.get(Options::Key::WINDOWSIZE), 1l)),
+                                                                  mCache(cache),
+                                                                  mBuffers(buffers),
+                                                                  mFileIo(file_io),
+                                                                  mCommit(commit),
+                                                                  mWakeFd(wake_fd) {
   mFilePath = std::move(file);
   mOptions = std::move(options);
   mTransmissionMode = std::move(transmission_mode);
 
-  struct sigaction sa;
-  sa.sa_handler = ConnectionSigUsrHandler;
-
-  sigemptyset(&sa.sa_mask);
-  sa.sa_flags = 0;
-  sigaction(SIGUSR1, &sa, NULL);
-
   mBlockNumber = 0;
+  mWindowSize = std::max(mOptions.get(Options::Key::WINDOWSIZE), 1l);
+  // OACK or ACK may precede the blocks
+  mWindow.reserve(mWindowSize + 1);
+  mSparePackets.reserve(mWindowSize + 1);
+  mFinalRead = false;
+  mServeBlocks = false;
+  mReadOffset = 0;
+  mPrefetched = 0;
+  mFileSize = 0;
+  mCacheKey = {};
+  mReceivedInWindow = 0;
+  mTransmitted = 0;
+  mInFlight = 0;
+  mAwaitingFile = false;
   mState = State::INIT;
-  mSocketFd = socket(AF_INET, SOCK_DGRAM, 0);
+  mMode = Mode::DOWNLOAD;
+  mSocketFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
   mClientAddr = client_address;
 
   mErrorPacket = std::nullopt;
@@ -30,100 +49,101 @@ TFTP::Connection::Connection(std::string file, Options::map_t options, sockaddr_
   mConnectionAddr.sin_port = htons(0);
   mConnectionAddr.sin_addr.s_addr = htonl(INADDR_ANY);
 
-  struct timeval read_timeout;
-  read_timeout.tv_sec = Options::get("timeout", mOptions);
-  read_timeout.tv_usec = 0;
-
-  setsockopt(mSocketFd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof read_timeout);
-
   bind(mSocketFd, (struct sockaddr *) &mConnectionAddr, sizeof(mConnectionAddr));
   socklen_t connection_len = sizeof(mConnectionAddr);
   getsockname(mSocketFd, (struct sockaddr *) &mConnectionAddr, &connection_len);
   mConnectionPort = mConnectionAddr.sin_port;
 
-  mLastPacket = nullptr;
+  mReceiveBuffer = mBuffers.acquire(std::max(mOptions.get(Options::Key::BLKSIZE), 512l) + 4);
+  mReceiveOffset = 0;
+  mReceiveLength = 0;
+  mSegmentSize = 0;
+  mReceiveAddress = {};
 }
 
-void TFTP::Connection::serveDownload() {
+void TFTP::Connection::enableCoalescing() {
+#ifdef UDP_GRO
+  int enable = 1;
+  if (setsockopt(mSocketFd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0) {
+    mReceiveBuffer = mBuffers.acquire(COALESCED_SIZE);
+  }
+#endif
+}
+
+void TFTP::Connection::startDownload() {
+  mMode = Mode::DOWNLOAD;
   mState = State::RECEIVED_RRQ;
 
-  std::unique_ptr<IInputWrapper> input_file;
   if (mTransmissionMode == "octet") {
-    input_file = std::make_unique<Octet::InputFile>(mFilePath);
+    // blocks of regular file are sent straight from memory, stream is the fallback for special files
+    // attributes of hot file are cached next to its blocks, so its transfer makes no filesystem calls
+    std::optional<BlockCache::FileInfo> info = mCache.getFile(mFilePath);
+    struct stat status = {};
+    if (!info && stat(mFilePath.c_str(), &status) == 0 && S_ISREG(status.st_mode)) {
+      info = BlockCache::FileInfo{
+          static_cast<uint64_t>(status.st_dev), static_cast<uint64_t>(status.st_ino),
+          static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec,
+          static_cast<uint64_t>(status.st_size)};
+      mCache.putFile(mFilePath, *info);
+    }
+    if (info) {
+      mFileSize = info->mSize;
+      mCacheKey.mPath = mFilePath;
+      mCacheKey.mDevice = info->mDevice;
+      mCacheKey.mInode = info->mInode;
+      mCacheKey.mModified = info->mModified;
+      mCacheKey.mSize = info->mSize;
+      mCacheKey.mBlockSize = static_cast<uint32_t>(mOptions.get(Options::Key::BLKSIZE));
+      // without the cache every block comes from the mapping, so the file is checked right away
+      if (!mCache.enabled()) mMapping = MappedFile::open(mFilePath);
+      mServeBlocks = mCache.enabled() || mMapping;
+    }
+    if (!mServeBlocks) mInputFile = std::make_unique<Octet::InputFile>(mFilePath);
   } else if (mTransmissionMode == "netascii") {
-    input_file = std::make_unique<NetAscii::InputFile>(mFilePath);
+    mInputFile = std::make_unique<NetAscii::InputFile>(mFilePath);
   } else {
     sendPacket(ErrorPacket{4, "Illegal TFTP operation"});
     mState = State::FINISHED;
     return;
   }
 
-  if (!input_file->is_open()) {
+  if (!mServeBlocks && !mInputFile->is_open()) {
     sendPacket(ErrorPacket{1, "File not found"});
     mState = State::FINISHED;
     return;
   }
+  if (!mServeBlocks) {
+    auto block_size = static_cast<size_t>(mOptions.get(Options::Key::BLKSIZE));
+    // stream is read by the file io pool two windows ahead, so the next window is ready when its ACK arrives
+    mInputFile = std::make_unique<ReadAheadInput>(std::move(mInputFile), static_cast<std::streamsize>(block_size),
+                                                  2 * mWindowSize, mBuffers, mFileIo, mSocketFd);
+    mBlocks = std::make_shared<BufferPool::Buffer>(mBuffers.acquire(mWindowSize * block_size));
+  }
 
-  mBlockNumber = 0;
-  bool send = true;
-  while (mState != State::FINAL_ACK and mState != State::ERROR) {
-    std::vector<char> buffer(std::max(Options::get("blksize", mOptions), 512l) + 4);
-
-    if (mBlockNumber == 0) {
-      if (Options::isAny(mOptions)) {
-        mBlockNumber = 0;
-        Options::map_t oack_options;
-        for (auto &[order, item]: mOptions) {
-          auto &[key, value, set] = item;
-          if (set) oack_options[order] = item;
-        }
-        long fs = std::filesystem::file_size(mFilePath);
-        if (Options::isSet("tsize", mOptions)) oack_options[2] = std::tuple("tsize", fs, true);
-
-        mLastPacket = std::make_unique<OACKPacket>(oack_options);
-      } else {
-        mBlockNumber = 1;
-        input_file->read(buffer.data(), Options::get("blksize", mOptions));
-        buffer.resize(input_file->gcount());
-        mLastPacket = std::make_unique<DataPacket>(mBlockNumber, std::vector<uint8_t>(buffer.begin(), buffer.end()));
-      }
-    } else {
-      input_file->read(buffer.data(), Options::get("blksize", mOptions));
-      buffer.resize(input_file->gcount());
-      mLastPacket = std::make_unique<DataPacket>(mBlockNumber, std::vector<uint8_t>(buffer.begin(), buffer.end()));
-    }
-
-    auto packet = sendAndReceive(*mLastPacket, send);
+  mState = State::DATA_TRANSFER;
+  // client waiting for the first window gives up after the same time as for any other
+  mTimers.arm(mIdleTimer, mOptions.getTimeout() * MAX_RETRIES);
 
-    auto error_packet = dynamic_cast<ErrorPacket *>(packet.get());
-    if (error_packet) {
-      break;
-    }
-    auto ack_packet = expectPacketType<ACKPacket>(std::move(packet));
-    if (!ack_packet) break;
-    auto blockNum = ack_packet->getBlockNumber();
-    if (blockNum == mBlockNumber) {
-      mBlockNumber++;
-      send = true;
-      if (input_file->eof()) break;
-
-    } else if (blockNum > mBlockNumber) {
-      mState = State::ERROR;
-      mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
-      break;
-    } else if (blockNum < mBlockNumber) {
-      send = false;
-    }
+  mBlockNumber = 0;
+  if (!mOptions.isAny()) {
+    mBlockNumber = 1;
+    advanceWindow();
+    return;
   }
 
-  if (mErrorPacket.has_value()) {
-    sendPacket(*mErrorPacket);
+  Options::Set oack_options = mOptions;
+  if (mOptions.isSet(Options::Key::TSIZE)) {
+    auto size = mServeBlocks ? mFileSize : std::filesystem::file_size(mFilePath);
+    oack_options.set(Options::Key::TSIZE, static_cast<long>(size));
   }
 
-  mState = State::FINISHED;
+  // OACK takes place of block 0 in the window
+  mWindow.push_back(std::make_unique<OACKPacket>(oack_options));
+  transmit();
 }
 
-void TFTP::Connection::serveUpload() {
+void TFTP::Connection::startUpload() {
+  mMode = Mode::UPLOAD;
   mState = State::RECEIVED_WRQ;
   if (std::filesystem::exists(mFilePath)) {
     sendPacket(ErrorPacket{6, "File already exists"});
@@ -131,22 +151,21 @@ void TFTP::Connection::serveUpload() {
     return;
   }
 
+  // port of the connection tells apart concurrent uploads of the same file
+  std::filesystem::path target{mFilePath};
+  mStagingPath = target.parent_path() /
+                 ("." + target.filename().string() + "." + std::to_string(ntohs(mConnectionPort)) + ".part");
+
   mBlockNumber = 1;
-  mLastPacket = std::make_unique<ACKPacket>(mBlockNumber - 1);
+  mWindow.push_back(std::make_unique<ACKPacket>(mBlockNumber - 1));
 
-  Options::map_t oack_options;
-  for (auto &[order, item]: mOptions) {
-    auto &[key, value, set] = item;
-    if (set) oack_options[order] = item;
-  }
-  if (!oack_options.empty()) mLastPacket = std::make_unique<OACKPacket>(oack_options);
+  if (mOptions.isAny()) mWindow.back() = std::make_unique<OACKPacket>(mOptions);
 
   std::unique_ptr<IOutputWrapper> output_file;
-
   if (mTransmissionMode == "octet") {
-    output_file = std::make_unique<Octet::OutputFile>(mFilePath);
+    output_file = std::make_unique<Octet::OutputFile>(mStagingPath);
   } else if (mTransmissionMode == "netascii") {
-    output_file = std::make_unique<NetAscii::OutputFile>(mFilePath);
+    output_file = std::make_unique<NetAscii::OutputFile>(mStagingPath);
   } else {
     sendPacket(ErrorPacket{4, "Illegal TFTP operation"});
     mState = State::FINISHED;
@@ -158,127 +177,476 @@ void TFTP::Connection::serveUpload() {
     mState = State::FINISHED;
     return;
   }
+  // blocks are written by the file io pool, so ACKs do not wait for the disk
+  mOutputFile = std::make_unique<WriteBehindOutput>(std::move(output_file),
+                                                    static_cast<size_t>(mOptions.get(Options::Key::BLKSIZE)),
+                                                    2 * mWindowSize, mBuffers, mFileIo, mSocketFd);
 
-  while (mState != State::FINAL_ACK && mState != State::ERROR) {
-    auto packet = sendAndReceive(*mLastPacket, true);
+  enableCoalescing();
 
-    if (!packet) break;
+  mState = State::DATA_TRANSFER;
+  transmit();
+}
 
-    auto error_packet = dynamic_cast<ErrorPacket *>(packet.get());
-    if (error_packet) {
-      break;
+void TFTP::Connection::handleIncoming() {
+  while (!isFinished()) {
+    std::optional<PacketView> packet;
+    try {
+      packet = receivePacket();
+    } catch (TFTP::UndefinedException &e) {
+      fail(ErrorPacket(0, "Undefined error"));
+      return;
+    } catch (TFTP::InvalidTIDException &e) {
+      // stray datagram was already answered, it does not affect this transfer
+      continue;
+    } catch (TFTP::PacketFormatException &e) {
+      fail(ErrorPacket(4, "Illegal TFTP operation"));
+      return;
     }
 
-    auto data_packet = expectPacketType<DataPacket>(std::move(packet));
+    // nothing more to read
+    if (!packet) return;
 
-    if (!data_packet) break;
+    if (mMode == Mode::DOWNLOAD) {
+      processDownloadPacket(*packet);
+    } else {
+      processUploadPacket(*packet);
+    }
+  }
+}
 
-    auto data = data_packet->getData();
-    if (data_packet->getBlockNumber() == mBlockNumber) {
-      output_file->write(data_packet->getData());
-      if (data_packet->getData().size() < Options::get("blksize", mOptions)) {
-        mState = State::FINAL_ACK;
-      }
-      // Increment block number only after it is valid packet
-      mBlockNumber++;
-      mLastPacket = std::make_unique<ACKPacket>(mBlockNumber - 1);
-    } else if (data_packet->getBlockNumber() > mBlockNumber) {
-      mState = State::ERROR;
-      mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
-      break;
-    } else if (data_packet->getBlockNumber() < mBlockNumber) {
-      mLastPacket = std::make_unique<ACKPacket>(mBlockNumber - 1);
+void TFTP::Connection::handleTimeout() {
+  if (isFinished() || mAwaitingFile) return;
+
+  mRtt.backoff();
+  mSentAt.reset();
+  // only the blocks in flight were lost, the window collapses to its first block
+  if (mMode == Mode::DOWNLOAD) mCongestion.timedOut(static_cast<long>(mInFlight));
+  sendWindow();
+  mTimers.arm(mRetransmitTimer, mRtt.getTimeout());
+}
+
+void TFTP::Connection::processDownloadPacket(const PacketView &packet) {
+  if (std::holds_alternative<ErrorView>(packet)) {
+    mState = State::ERROR;
+    finish();
+    return;
+  }
+
+  auto ack_packet = expectPacketType<ACKView>(packet);
+  if (!ack_packet) {
+    finish();
+    return;
+  }
+
+  // ACK is cumulative, ACK of a block inside the window rewinds the window to the next block
+  auto blockNum = ack_packet->mBlockNumber;
+  uint16_t acked = blockNum - mBlockNumber + 1;
+  uint16_t last_sent = mBlockNumber + mTransmitted - 1;
+  if (acked >= 1 && acked <= mTransmitted) {
+    measureRtt();
+    // ACK short of the blocks in flight is the receiver reporting a gap
+    if (acked < mInFlight) mCongestion.lost(static_cast<long>(mInFlight - acked));
+    mCongestion.acknowledged(acked);
+    for (auto it = mWindow.begin(); it != mWindow.begin() + acked; ++it) {
+      auto data_packet = dynamic_cast<DataPacket *>(it->get());
+      if (!data_packet) continue;
+      // borrowed block is released right away
+      *data_packet = DataPacket(0, SharedBytes{});
+      mSparePackets.push_back(std::move(*it));
+    }
+    mWindow.erase(mWindow.begin(), mWindow.begin() + acked);
+    mTransmitted -= std::min(static_cast<size_t>(acked), mTransmitted);
+    mInFlight -= std::min(static_cast<size_t>(acked), mInFlight);
+    mBlockNumber += acked;
+    if (mWindow.empty() && mFinalRead) {
+      finish();
+      return;
     }
+    advanceWindow();
+  } else if (static_cast<int16_t>(blockNum - last_sent) > 0) {
+    fail(ErrorPacket{4, "Illegal TFTP operation"});
   }
+  // Duplicate ACK is ignored, lost packet is resent after timeout
+}
 
-  // Success
-  if (mState == State::FINAL_ACK) {
-    auto ack_packet = ACKPacket(mBlockNumber - 1);
-    sendPacket(ack_packet);
-    mState = State::FINISHED;
+void TFTP::Connection::processUploadPacket(const PacketView &packet) {
+  // whole file is received, retransmitted last block is answered by the final ACK once the commit is done
+  if (mState == State::COMMITTING) return;
+
+  if (std::holds_alternative<ErrorView>(packet)) {
+    mState = State::ERROR;
+    finish();
     return;
   }
 
-  // mState should only be ERROR here
-  if (mErrorPacket.has_value()) {
-    sendPacket(*mErrorPacket);
-    mState = State::FINISHED;
+  auto data_packet = expectPacketType<DataView>(packet);
+  if (!data_packet) {
+    finish();
+    return;
+  }
+  // segment of coalesced datagram longer than the negotiated block is not a valid block
+  if (data_packet->mData.size() > static_cast<size_t>(mOptions.get(Options::Key::BLKSIZE))) {
+    fail(ErrorPacket{4, "Illegal TFTP operation"});
+    return;
+  }
+  // blocks received while the ring is full are dropped, the client resends them after the ACK sent once it has room
+  if (mAwaitingFile) return;
+
+  auto ahead = static_cast<int16_t>(data_packet->mBlockNumber - mBlockNumber);
+  if (ahead == 0) {
+    measureRtt();
+    // error of some earlier block written in the background
+    if (!mOutputFile->good()) {
+      fail(ErrorPacket{3, "Disk full or allocation exceeded"});
+      return;
+    }
+    // payload is copied straight from the receive buffer, disk slower than the client stops the ACKs
+    auto data = data_packet->mData;
+    if (!mOutputFile->write(data)) {
+      mAwaitingFile = true;
+      mRetransmitTimer.cancel();
+      mTimers.arm(mIdleTimer, mOptions.getTimeout() * MAX_RETRIES);
+      return;
+    }
+    // Increment block number only after it is valid packet
+    mBlockNumber++;
+
+    // Success
+    if (data.size() < mOptions.get(Options::Key::BLKSIZE)) {
+      // final ACK is sent only once the whole file is written and under its name,
+      // client keeps retransmitting the last block until then
+      mRetransmitTimer.cancel();
+      mIdleTimer.cancel();
+      mState = State::COMMITTING;
+      // descriptor is kept only for the committer, published file is closed by the pool
+      mOutputFile->flush(mCommit.isEnabled());
+      commitUpload();
+      return;
+    }
+
+    if (++mReceivedInWindow == mWindowSize) {
+      acknowledge();
+    } else {
+      mTimers.arm(mIdleTimer, mOptions.getTimeout() * MAX_RETRIES);
+    }
+  } else if (ahead >= mWindowSize) {
+    fail(ErrorPacket{4, "Illegal TFTP operation"});
+  } else {
+    // gap in the window or duplicate block, sender rewinds to the block after our ACK
+    acknowledge();
   }
-  std::filesystem::remove(mFilePath);
 }
 
-void TFTP::Connection::sendPacket(const Packet &packet) {
-  std::vector<uint8_t> data = packet.serialize();
-  sendto(mSocketFd, data.data(), data.size(), 0, (struct sockaddr *) &mClientAddr,
-         sizeof(mClientAddr));
+std::unique_ptr<TFTP::Packet> TFTP::Connection::readBlock(uint16_t block_number) {
+  if (mServeBlocks) {
+    auto block_size = static_cast<size_t>(mOptions.get(Options::Key::BLKSIZE));
+    size_t length = std::min(block_size, mFileSize - mReadOffset);
+    mCacheKey.mBlock = mReadOffset / block_size;
+    mReadOffset += length;
+    if (length < block_size) mFinalRead = true;
+
+    // block number follows from the block index, so the whole packet can be cached
+    SharedBytes serialized = mCache.get(mCacheKey);
+    if (serialized.mData) return makeDataPacket(DataPacket::fromSerialized(std::move(serialized)));
+
+    SharedBytes payload;
+    if (length > 0) {
+      if (!mMapping) mMapping = MappedFile::open(mFilePath);
+      // file was removed, replaced or changed since the transfer started
+      if (!mMapping || mMapping->size() != mFileSize || !mMapping->isOf(mCacheKey.mDevice, mCacheKey.mInode)) {
+        return nullptr;
+      }
+
+      // kernel reads the blocks ahead in the background instead of faulting them in while the client waits
+      size_t ahead = std::max(2 * mWindowSize * block_size, PREFETCH_SIZE);
+      if (mPrefetched < mReadOffset + ahead) {
+        size_t start = std::max(mPrefetched, mReadOffset);
+        mPrefetched = mReadOffset + 2 * ahead;
+        mMapping->prefetch(start, mPrefetched - start);
+      }
+      payload = SharedBytes{mMapping, mMapping->data() + mReadOffset - length, length};
+    }
+
+    DataPacket packet(block_number, std::move(payload));
+    // block read once is served straight from the mapping, only block missed again is worth the copy
+    if (mCache.admit(mCacheKey)) {
+      // copy out of the mapping survives the file truncated meanwhile
+      std::vector<uint8_t> bytes(DataPacket::HEADER_SIZE + length);
+      packet.serializeHeaderInto(bytes);
+      if (length > 0 && !mMapping->copy(mReadOffset - length, length, bytes.data() + DataPacket::HEADER_SIZE)) {
+        fail(ErrorPacket{0, "File was truncated"});
+        return nullptr;
+      }
+      serialized = mCache.put(mCacheKey, std::move(bytes));
+      if (serialized.mData) return makeDataPacket(DataPacket::fromSerialized(std::move(serialized)));
+    }
+    return makeDataPacket(std::move(packet));
+  }
+
+  // slots are used in turn, the window never holds more blocks than there are slots,
+  // a retransmission still queued when its slot is reused carries stale header, so the client ignores it
+  auto block_size = static_cast<size_t>(mOptions.get(Options::Key::BLKSIZE));
+  uint8_t *slot = mBlocks->data() + (mReadOffset / block_size) % mWindowSize * block_size;
+  mInputFile->read(reinterpret_cast<char *>(slot), static_cast<std::streamsize>(block_size));
+  auto length = static_cast<size_t>(mInputFile->gcount());
+  mReadOffset += length;
+  if (length < block_size) mFinalRead = true;
+  return makeDataPacket(DataPacket(block_number, SharedBytes{mBlocks, slot, length}));
 }
 
-std::unique_ptr<TFTP::Packet> TFTP::Connection::receivePacket() const {
-  std::vector<uint8_t> buffer(std::max(Options::get("blksize", mOptions), 512l) + 4);
-  sockaddr_in from_address = {};
-  socklen_t from_length = sizeof(from_address);
-  ssize_t received = recvfrom(mSocketFd, buffer.data(), buffer.size(), 0, (struct sockaddr *) &from_address,
-                              &from_length);
+std::unique_ptr<TFTP::Packet> TFTP::Connection::makeDataPacket(DataPacket packet) {
+  if (mSparePackets.empty()) return std::make_unique<DataPacket>(std::move(packet));
 
+  auto spare = std::move(mSparePackets.back());
+  mSparePackets.pop_back();
+  *static_cast<DataPacket *>(spare.get()) = std::move(packet);
+  return spare;
+}
 
-  if (received <= 0) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-      throw TFTP::TimeoutException();
-    } else {
-      throw TFTP::UndefinedException();
+bool TFTP::Connection::fillWindow() {
+  mAwaitingFile = false;
+  auto limit = static_cast<size_t>(std::min(mWindowSize, mCongestion.get()));
+  auto block_size = static_cast<std::streamsize>(mOptions.get(Options::Key::BLKSIZE));
+  while (!mFinalRead && mWindow.size() < limit) {
+    // stream is read in the background, the window waits for its blocks instead of the event loop
+    if (!mServeBlocks && !mInputFile->ready(block_size)) {
+      mAwaitingFile = true;
+      return true;
     }
+    auto packet = readBlock(mBlockNumber + mWindow.size());
+    if (!packet) {
+      if (!isFinished()) fail(ErrorPacket{2, "Access violation"});
+      return false;
+    }
+    mWindow.push_back(std::move(packet));
   }
+  return true;
+}
 
-  buffer.resize(received);
-  std::unique_ptr<Packet> packet;
-  try {
-    packet = Packet::deserialize(buffer);
-  } catch (TFTP::PacketFormatException &e) {
-    throw e;
+void TFTP::Connection::advanceWindow() {
+  if (!fillWindow()) return;
+  if (mAwaitingFile) {
+    // whole window goes out at once when it is read, nothing waits for acknowledgement meanwhile
+    mRetransmitTimer.cancel();
+    return;
   }
+  transmit();
+}
 
-  std::cerr << packet->formatPacket(inet_ntoa(mClientAddr.sin_addr), ntohs(mClientAddr.sin_port),
-                                    ntohs(mConnectionPort));
+void TFTP::Connection::handleSendFault() {
+  // kernel fails to read blocks borrowed from the mapping once the file is truncated under them
+  if (!isFinished() && mMapping && mMapping->isTruncated()) fail(ErrorPacket{0, "File was truncated"});
+}
 
-  if (from_address.sin_port != mClientAddr.sin_port || from_address.sin_addr.s_addr != mClientAddr.sin_addr.s_addr) {
-    throw TFTP::InvalidTIDException();
+void TFTP::Connection::handleFileReady() {
+  if (mMode == Mode::DOWNLOAD) {
+    if (mState == State::DATA_TRANSFER && mAwaitingFile) advanceWindow();
+  } else if (mState == State::COMMITTING) {
+    if (!mCommitTicket) commitUpload();
+  } else if (mState == State::DATA_TRANSFER && mAwaitingFile) {
+    // client resends the blocks dropped meanwhile
+    mAwaitingFile = false;
+    acknowledge();
   }
+}
 
-  return packet;
+void TFTP::Connection::acknowledge() {
+  mReceivedInWindow = 0;
+  // ACK replacing the previous one reuses its packet
+  auto ack = mWindow.size() == 1 ? dynamic_cast<ACKPacket *>(mWindow.front().get()) : nullptr;
+  if (ack) {
+    *ack = ACKPacket(mBlockNumber - 1);
+  } else {
+    mWindow.clear();
+    mWindow.push_back(std::make_unique<ACKPacket>(mBlockNumber - 1));
+  }
+  transmit();
 }
 
-void TFTP::Connection::cleanup() {
-  if (mState != State::FINISHED) {
-    sendPacket(ErrorPacket{0, "Server shutting down"});
+void TFTP::Connection::transmit() {
+  mSentAt = TimerWheel::clock::now();
+  sendWindow();
+  mTimers.arm(mRetransmitTimer, mRtt.getTimeout());
+  mTimers.arm(mIdleTimer, mOptions.getTimeout() * MAX_RETRIES);
+}
+
+void TFTP::Connection::sendWindow() {
+  if (mMode != Mode::DOWNLOAD) {
+    for (auto &packet: mWindow) sendPacket(*packet);
+    return;
+  }
+
+  // blocks past the congestion window stay unsent until acknowledgements open it again
+  size_t burst = std::min(mWindow.size(), static_cast<size_t>(mCongestion.get()));
+  for (size_t i = 0; i < burst; i++) sendPacket(*mWindow[i]);
+  fprintf(stderr, "BURST from %u n=%zu win=%zu inflight=%zu\n", mBlockNumber, burst, mWindow.size(), mInFlight);
+
+  // final block is acknowledged by the receiver on its own, duplicate only triggers the ACK, it is not a resend
+  bool final_block = mFinalRead && burst == mWindow.size();
+  if (!final_block && burst < static_cast<size_t>(mWindowSize) && dynamic_cast<DataPacket *>(mWindow[burst - 1].get())) {
+    sendPacket(*mWindow[burst - 1]);
+  }
+  mCongestion.sent(static_cast<long>(burst - std::min(burst, mTransmitted)));
+  mCongestion.resent(static_cast<long>(std::min(burst, mTransmitted)));
+  mTransmitted = std::max(mTransmitted, burst);
+  mInFlight = burst;
+}
+
+void TFTP::Connection::measureRtt() {
+  if (!mSentAt.has_value()) return;
+  mRtt.sample(std::chrono::duration_cast<RttEstimator::duration>(TimerWheel::clock::now() - *mSentAt));
+  mSentAt.reset();
+}
+
+void TFTP::Connection::completeUpload(int error) {
+  if (error == EEXIST) {
+    // file of the same name was uploaded meanwhile
+    fail(ErrorPacket{6, "File already exists"});
+  } else if (error == ENOSPC || error == EDQUOT) {
+    fail(ErrorPacket{3, "Disk full or allocation exceeded"});
+  } else if (error != 0) {
+    fail(ErrorPacket{2, "Access violation"});
+  } else {
+    mState = State::FINAL_ACK;
+    sendPacket(ACKPacket(mBlockNumber - 1));
+    finish();
+  }
+}
+
+void TFTP::Connection::commitUpload() {
+  auto flushed = mOutputFile->flushed();
+  if (!flushed.has_value()) return;
+  int fd = mOutputFile->release();
+  mOutputFile.reset();
+  if (!*flushed) {
+    fail(ErrorPacket{3, "Disk full or allocation exceeded"});
+    return;
+  }
+
+  if (!mCommit.isEnabled()) {
+    completeUpload(GroupCommit::publish(mStagingPath, mFilePath));
+    return;
+  }
+  // committer syncs the file through the descriptor the upload was written by
+  mCommitTicket = mCommit.submit(mStagingPath, mFilePath, mWakeFd, fd);
+}
+
+void TFTP::Connection::handleCommitted() {
+  // upload still being flushed has no ticket yet
+  if (mState != State::COMMITTING || !mCommitTicket) return;
+
+  auto error = mCommit.result(*mCommitTicket);
+  if (!error.has_value()) return;
+  mCommitTicket.reset();
+  completeUpload(*error);
+}
+
+void TFTP::Connection::fail(ErrorPacket error_packet) {
+  mErrorPacket = std::move(error_packet);
+  mState = State::ERROR;
+  finish();
+}
+
+void TFTP::Connection::finish() {
+  if (mErrorPacket.has_value()) {
+    sendPacket(*mErrorPacket);
+  }
+
+  mInputFile.reset();
+  mBlocks.reset();
+  mMapping.reset();
+  mOutputFile.reset();
+  mWindow.clear();
+
+  // mState should only be ERROR here if upload did not succeed, file already published under its name is kept
+  if (mMode == Mode::UPLOAD && mState != State::FINAL_ACK) {
+    std::filesystem::remove(mStagingPath);
+  }
+
+  mRetransmitTimer.cancel();
+  mIdleTimer.cancel();
+  mState = State::FINISHED;
+}
+
+void TFTP::Connection::sendPacket(const Packet &packet) {
+  // cached packet and block borrowed from the mapped file go out without being copied into the datagram
+  auto data_packet = dynamic_cast<const DataPacket *>(&packet);
+  if (data_packet && data_packet->getSerialized().mData) {
+    mIo.queue(mSocketFd, 0, data_packet->getSerialized(), mClientAddr);
+    return;
+  }
+  if (data_packet && !data_packet->getSharedData().empty()) {
+    data_packet->serializeHeaderInto(
+            mIo.queue(mSocketFd, DataPacket::HEADER_SIZE, data_packet->getSharedData(), mClientAddr));
+    return;
   }
+  // rest is serialized straight into the buffer reused by the backend, retransmits allocate nothing
+  packet.serializeInto(mIo.queue(mSocketFd, packet.serializedSize(), {}, mClientAddr));
 }
 
-std::unique_ptr<TFTP::Packet> TFTP::Connection::sendAndReceive(const Packet &packetToSend, bool send) {
-  int retries = 0;
-  while (retries < 3) {
-    if (send) {
-      sendPacket(packetToSend);
+std::optional<TFTP::PacketView> TFTP::Connection::receivePacket() {
+  if (mReceiveOffset >= mReceiveLength) {
+    iovec iov = {mReceiveBuffer.data(), mReceiveBuffer.size()};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr message = {};
+    message.msg_name = &mReceiveAddress;
+    message.msg_namelen = sizeof(mReceiveAddress);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = recvmsg(mSocketFd, &message, 0);
+    if (received < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+        return std::nullopt;
+      } else {
+        throw TFTP::UndefinedException();
+      }
     }
-    try {
-      return receivePacket();
-    } catch (TFTP::TimeoutException &e) {
-      retries++;
-      if (retries == 3) {
-        mErrorPacket = ErrorPacket(0, "Timeout");
-        break;
+
+    mReceiveOffset = 0;
+    mReceiveLength = received;
+    mSegmentSize = received;
+#ifdef UDP_GRO
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+      if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+        int segment_size;
+        memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+        if (segment_size > 0) mSegmentSize = segment_size;
       }
-      continue;
-    } catch (TFTP::UndefinedException &e) {
-      mErrorPacket = ErrorPacket(0, "Undefined error");
-      break;
-    } catch (TFTP::InvalidTIDException &e) {
-      mErrorPacket = ErrorPacket(5, "Unknown transfer ID");
-      break;
-    } catch (TFTP::PacketFormatException &e) {
-      mErrorPacket = ErrorPacket(4, "Illegal TFTP operation");
-      break;
     }
+#endif
   }
-  mState = State::ERROR;
-  return nullptr;
-}
\ No newline at end of file
+
+  // datagram from other port is rejected before it is parsed, the transfer itself goes on (RFC 1350, section 4)
+  if (mReceiveAddress.sin_port != mClientAddr.sin_port || mReceiveAddress.sin_addr.s_addr != mClientAddr.sin_addr.s_addr) {
+    mReceiveOffset = mReceiveLength;
+    mIo.send(mSocketFd, ErrorPacket{5, "Unknown transfer ID"}.serialize(), mReceiveAddress);
+    throw TFTP::InvalidTIDException();
+  }
+
+  // every segment but the last one is mSegmentSize bytes long
+  size_t length = std::min(mSegmentSize, mReceiveLength - mReceiveOffset);
+  auto segment = std::span<const uint8_t>(mReceiveBuffer.span()).subspan(mReceiveOffset, length);
+  mReceiveOffset += std::max(length, static_cast<size_t>(1));
+
+  PacketView packet = parsePacket(segment);
+
+  printPacket(std::cerr, packet, inet_ntoa(mClientAddr.sin_addr), ntohs(mClientAddr.sin_port), ntohs(mConnectionPort));
+
+  return packet;
+}
+
+void TFTP::Connection::cleanup() {
+  // committer could still rename the file, and it writes the eventfd of the worker,
+  // upload still being flushed is not published, its output is dropped by fail
+  if (mState == State::COMMITTING && mCommitTicket) {
+    mCommit.wait(*mCommitTicket);
+    handleCommitted();
+  }
+  if (mState != State::FINISHED) {
+    fail(ErrorPacket{0, "Server shutting down"});
+  }
+}
@@ -5,6 +5,7 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <sys/socket.h>
 
 #include <csignal>
@@ -12,34 +13,114 @@
 #include <algorithm>
 
 #include "../utils/ArgParser.h"
+#include "../utils/BlockCache.h"
+#include "../utils/BufferPool.h"
+#include "../utils/CongestionWindow.h"
+#include "../utils/FileIoPool.h"
+#include "../utils/GroupCommit.h"
 #include "../utils/IInputWrapper.h"
 #include "../utils/IOutputWrapper.h"
+#include "../utils/MappedFile.h"
 #include "../utils/Options.h"
+#include "../utils/ReadAheadInput.h"
+#include "../utils/RttEstimator.h"
+#include "../utils/TimerWheel.h"
+#include "../utils/WriteBehindOutput.h"
 #include "../utils/utils.h"
+#include "IoBackend.h"
 #include "Packet.h"
+#include "PacketView.h"
 #include "common.h"
 
 
 namespace TFTP {
   /**
-   * @brief Connection class, handles the while tftp exchange with a single client on server side
+   * @brief Connection class, handles the while tftp exchange with a single client on server side,
+   * the exchange is driven as a non-blocking state machine by the server event loop
    */
   class Connection {
+    IoBackend &mIo;
     int mSocketFd;
     uint16_t mConnectionPort;
     sockaddr_in mConnectionAddr;
 
     sockaddr_in mClientAddr;
 
+    // largest datagram coalesced by GRO
+    static constexpr size_t COALESCED_SIZE = 65536;
+    // least part of the mapped file asked to be read ahead at once
+    static constexpr size_t PREFETCH_SIZE = 1 << 20;
+
+    // last received datagram, with GRO enabled it can hold several consecutive datagrams of mSegmentSize bytes
+    BufferPool::Buffer mReceiveBuffer;
+    size_t mReceiveOffset;
+    size_t mReceiveLength;
+    size_t mSegmentSize;
+    sockaddr_in mReceiveAddress;
+
     State mState;
+    Mode mMode;
     std::string mTransmissionMode;
+    // download: block number of the first packet in window, upload: next expected block
     uint16_t mBlockNumber;
+    long mWindowSize;
+    // download: short block was read, upload: blocks received since last ACK
+    bool mFinalRead;
+    long mReceivedInWindow;
+
+    TimerWheel &mTimers;
+    TimerWheel::Timer mRetransmitTimer;
+    // expires when the client makes no progress for the whole retry budget
+    TimerWheel::Timer mIdleTimer;
+
+    RttEstimator mRtt;
+    // download only, limits blocks in window below the negotiated windowsize
+    CongestionWindow mCongestion;
+    // download: packets at the front of the window that were already sent, the rest is sent for the first time
+    size_t mTransmitted;
+    // download: packets at the front of the window sent by the last burst, ACK short of them reports a loss,
+    // blocks left out of the burst after a loss were already counted as lost
+    size_t mInFlight;
+    // download: window waits for the file io pool, it is sent once the pool reports the file is ready,
+    // upload: ring of the output is full, blocks are dropped and not acknowledged until it has room
+    bool mAwaitingFile;
+    // unset after retransmission, as the response can belong to any of the copies
+    std::optional<TimerWheel::clock::time_point> mSentAt;
 
     std::optional<ErrorPacket> mErrorPacket;
-    std::unique_ptr<Packet> mLastPacket;
+    // packets waiting for acknowledgement, retransmitted together, reserved for the whole window up front
+    std::vector<std::unique_ptr<Packet>> mWindow;
+    // acknowledged data packets, reused for the next blocks
+    std::vector<std::unique_ptr<Packet>> mSparePackets;
+
+    std::unique_ptr<IInputWrapper> mInputFile;
+    // octet download of regular file is served from the block cache and the file mapping instead of mInputFile,
+    // the file is mapped on first block missing in the cache
+    bool mServeBlocks;
+    BlockCache &mCache;
+    BufferPool &mBuffers;
+    // reads streamed input ahead and writes uploads behind, its tasks notify the worker under mSocketFd
+    FileIoPool &mFileIo;
+    // blocks read from mInputFile, one slot per block of the window, queued sends keep it alive
+    std::shared_ptr<BufferPool::Buffer> mBlocks;
+    std::shared_ptr<MappedFile> mMapping;
+    // offset of the next block to be read
+    size_t mReadOffset;
+    // end of the part of the mapped file the kernel was asked to read ahead
+    size_t mPrefetched;
+    size_t mFileSize;
+    // key of the block being read, only the block index changes during the transfer
+    BlockCache::Key mCacheKey;
+    std::unique_ptr<WriteBehindOutput> mOutputFile;
+    GroupCommit &mCommit;
+    // eventfd of the worker, written when the commit of the upload is done
+    int mWakeFd;
+    std::shared_ptr<GroupCommit::Ticket> mCommitTicket;
 
     std::string mFilePath;
-    Options::map_t mOptions;
+    // upload is written under hidden name next to mFilePath and renamed once it is complete
+    std::filesystem::path mStagingPath;
+    Options::Set mOptions;
 
     /**
      * @brief Sends packet to the client
@@ -48,42 +129,125 @@ namespace TFTP {
     void sendPacket(const Packet &packet);
 
     /**
-     * @brief Receives packet from the client
-     * @return unique pointer to the received packet
+     * @brief Receives packet from the client without blocking, segments of coalesced datagram are returned
+     * one by one before the socket is read again, datagram from other transfer ID is answered with ERROR 5
+     * and InvalidTIDException is thrown
+     * @return view of the received packet valid until the next receive, nullopt if there is no packet waiting
+     */
+    [[nodiscard]] std::optional<PacketView> receivePacket();
+
+    /**
+     * @brief Lets the kernel coalesce consecutive datagrams from the client, used for uploads
+     */
+    void enableCoalescing();
+
+    /**
+     * @brief Sends all packets in window to the client and arms the retransmission and idle timers
+     */
+    void transmit();
+
+    /**
+     * @brief Sends packets in window, download sends only as many as the congestion window allows,
+     * burst shorter than the negotiated window ends with its last block sent twice, the receiver acknowledges
+     * the duplicate right away instead of waiting for the rest of the window
+     */
+    void sendWindow();
+
+    /**
+     * @brief Feeds round trip time of the last transmission to the estimator, once per transmission
+     */
+    void measureRtt();
+
+    /**
+     * @brief Reads blocks from the input file until the window is full or the last block is read,
+     * window is limited by the congestion window, stops early and sets mAwaitingFile if the next block
+     * is still being read in the background
+     * @return false if the file could not be read and the exchange failed
+     */
+    bool fillWindow();
+
+    /**
+     * @brief Fills the window and transmits it, or waits until the file io pool has read its blocks
+     */
+    void advanceWindow();
+
+    /**
+     * @brief Replaces the window by ACK of the last block received in order and transmits it
+     */
+    void acknowledge();
+
+    /**
+     * @brief Reads block from the block cache or the input file
+     * @param block_number number of the block
+     * @return data packet holding the block, nullptr if the file could not be read,
+     * the connection is already failed if the file was truncated
+     */
+    std::unique_ptr<Packet> readBlock(uint16_t block_number);
+
+    /**
+     * @brief Moves data packet into spare packet object, allocates new one only if there is none
+     * @param packet data packet
+     * @return packet to be put into window
+     */
+    std::unique_ptr<Packet> makeDataPacket(DataPacket packet);
+
+    /**
+     * @brief Handles expired retransmission timer, retransmits last packet and backs off
+     */
+    void handleTimeout();
+
+    /**
+     * @brief Handles packet received during download
+     * @param packet received packet
+     */
+    void processDownloadPacket(const PacketView &packet);
+
+    /**
+     * @brief Handles packet received during upload
+     * @param packet received packet
+     */
+    void processUploadPacket(const PacketView &packet);
+
+    /**
+     * @brief Publishes or submits for commit the upload whose output is flushed, returns right away
+     * while the flush is not done
+     */
+    void commitUpload();
+
+    /**
+     * @brief Sends the final ACK of committed upload, or error if the commit failed
+     * @param error errno of the commit, 0 on success
+     */
+    void completeUpload(int error);
+
+    /**
+     * @brief Sets error packet to be sent to the client and finishes the exchange
+     * @param error_packet error packet to be sent
      */
-    [[nodiscard]] std::unique_ptr<Packet> receivePacket() const;
+    void fail(ErrorPacket error_packet);
 
     /**
-     * @brief sends packet to the client if send is true, and then waits for response
-     * @param packetToSend packet to be sent
-     * @param send whether to send the packet, or just wait for response
-     * @return unique pointer to the received packet, null if error occured
+     * @brief Finishes the exchange, sends pending error packet and releases files,
+     * unfinished upload is removed, it never was under its name
      */
-    std::unique_ptr<Packet> sendAndReceive(const Packet &packetToSend, bool send);
+    void finish();
 
     /**
-     * expects packet of type T, if the packet is not of type T, sends error packet and sets state to ERROR,
-     * if it is of type T, releases it and returns new unique pointer downcast to T
-     * @tparam T expected type
+     * expects packet of type T, if the packet is not of type T, sets error packet to be sent and state to ERROR
+     * @tparam T expected view type
      * @param packet packet to be checked
-     * @return unique pointer of type T, nullptr if error occured
+     * @return pointer to the view of type T, nullptr if error occured
      */
     template<typename T>
-    [[nodiscard]] std::unique_ptr<T> expectPacketType(std::unique_ptr<Packet> packet) {
-      if (packet == nullptr) {
-        return nullptr;
-      }
-
-      auto castPacket = dynamic_cast<T *>(packet.release());
+    [[nodiscard]] const T *expectPacketType(const PacketView &packet) {
+      auto view = std::get_if<T>(&packet);
 
-      if (castPacket == nullptr) {
+      if (view == nullptr) {
         mErrorPacket = std::optional(ErrorPacket{4, "Illegal TFTP operation"});
         mState = State::ERROR;
-        return nullptr;
       }
 
-      packet.release();
-      return std::unique_ptr<T>(castPacket);
+      return view;
     }
 
   public:
@@ -93,26 +257,85 @@ namespace TFTP {
      * @param options options to be used in exchange
      * @param client_address client address
      * @param transmission_mode mode of transmission, either netascii or octet
+     * @param io backend used to send packets
+     * @param timers timer wheel driving retransmissions
+     * @param cache block cache shared by all connections
+     * @param buffers pool the receive buffer and read blocks are borrowed from
+     * @param commit committer of completed uploads
+     * @param wake_fd eventfd of the worker, written when the commit of the upload is done
+     * @param file_io pool doing blocking file io of the worker
+     */
+    Connection(std::string file_path, Options::Set options, sockaddr_in client_address, std::string transmission_mode,
+               IoBackend &io, TimerWheel &timers, BlockCache &cache, BufferPool &buffers, GroupCommit &commit,
+               int wake_fd, FileIoPool &file_io);
+
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    /**
+     * @brief Starts download from server, sends first packet and returns
+     */
+    void startDownload();
+
+    /**
+     * @brief Starts upload to server, sends first packet and returns
+     */
+    void startUpload();
+
+    /**
+     * @brief Handles all packets waiting on the connection socket, called when the socket is readable
+     */
+    void handleIncoming();
+
+    /**
+     * @brief Finishes upload whose commit is done, called when the worker is woken by the committer
      */
-    Connection(std::string file_path, Options::map_t options, sockaddr_in client_address, std::string transmission_mode);
+    void handleCommitted();
 
     /**
-     * @brief Handles downloading from server
+     * @brief Fails the download whose mapped file was truncated, called when the kernel could not read
+     * datagram sent from the connection
      */
-    void serveDownload();
+    void handleSendFault();
 
     /**
-     * @brief Handles uploading to server
+     * @brief Continues the exchange waiting for the file to be read, written or flushed, called when the file io pool
+     * notifies the connection
      */
-    void serveUpload();
+    void handleFileReady();
 
     /**
-     * @brief Cleans up the connection incase of it not being successful
+     * @brief Cleans up the connection incase of it not being successful, upload being committed is waited for
      */
     void cleanup();
 
+    /**
+     * @return true if the exchange is over and connection can be destroyed
+     */
+    [[nodiscard]] bool isFinished() const { return mState == State::FINISHED; }
+
+    /**
+     * @return socket used for the exchange
+     */
+    [[nodiscard]] int getSocketFd() const { return mSocketFd; }
+
+    /**
+     * @return direction of the transfer
+     */
+    [[nodiscard]] Mode getMode() const { return mMode; }
+
+    /**
+     * @return address of the client
+     */
+    [[nodiscard]] const sockaddr_in &getClientAddress() const { return mClientAddr; }
+
+    /**
+     * @return congestion window of the download
+     */
+    [[nodiscard]] const CongestionWindow &getCongestionWindow() const { return mCongestion; }
+
     ~Connection() {
-      close(mSocketFd);
+      mIo.close(mSocketFd);
     }
   };
 }// namespace TFTP
@@ -0,0 +1,514 @@
+// Matej Sirovatka, xsirov00
+
+#include "IoBackend.h"
+
+#include <poll.h>
+#include <unistd.h>
+
+#if __has_include(<linux/errqueue.h>)
+#include <linux/errqueue.h>
+#endif
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+#include "../utils/utils.h"
+
+std::unique_ptr<TFTP::IoBackend> TFTP::IoBackend::create(bool uring, bool zero_copy) {
+#ifdef IO_URING_SUPPORTED
+  if (uring) {
+    auto backend = std::make_unique<UringIoBackend>();
+    if (backend->is_open()) {
+      if (zero_copy) {
+        LOG("zero-copy sends are not supported with io_uring")
+      }
+      return backend;
+    }
+    LOG("io_uring is not available, falling back to syscalls")
+  }
+#endif
+  return std::make_unique<SyscallIoBackend>(zero_copy);
+}
+
+void TFTP::IoBackend::close(int fd) {
+  // deferred sends have to reach the kernel before the socket is closed
+  flush();
+  ::close(fd);
+}
+
+TFTP::SyscallIoBackend::SyscallIoBackend(bool zero_copy) : mQueue(BATCH), mHeaders(BATCH), mIovs(2 * BATCH),
+                                                             mControls(BATCH), mZeroCopy(zero_copy) {
+#if !defined(SO_ZEROCOPY) || !defined(MSG_ZEROCOPY) || !__has_include(<linux/errqueue.h>)
+  if (mZeroCopy) {
+    LOG("zero-copy sends are not supported, falling back to copying")
+  }
+  mZeroCopy = false;
+#endif
+#ifdef UDP_SEGMENT
+  // kernels without GSO support reject the option
+  int probe = socket(AF_INET, SOCK_DGRAM, 0);
+  int segment_size = 512;
+  mSegmentation = probe >= 0 && setsockopt(probe, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) == 0;
+  if (probe >= 0) close(probe);
+#endif
+}
+
+std::span<uint8_t> TFTP::SyscallIoBackend::queue(int fd, size_t size, SharedBytes payload, const sockaddr_in &address) {
+  if (mQueued == BATCH) flush();
+
+  // buffer keeps its capacity between flushes, only buffers pinned by zero-copy sends are given away
+  Message &message = mQueue[mQueued++];
+  message.mFd = fd;
+  message.mData.resize(size);
+  message.mPayload = std::move(payload);
+  message.mAddress = address;
+  return message.mData;
+}
+
+size_t TFTP::SyscallIoBackend::segmentRun(const Message *messages, size_t start, size_t end) const {
+  if (!mSegmentation) return 1;
+
+  // all segments but the last one have to be of the same size, the last one may be shorter
+  const Message &first = messages[start];
+  size_t segment_size = first.size();
+  auto limit = mSegmentLimits.find(first.mFd);
+  if (limit != mSegmentLimits.end() && segment_size >= limit->second) return 1;
+
+  size_t total = segment_size;
+  size_t index = start + 1;
+  while (index < end && index - start < MAX_SEGMENTS) {
+    const Message &message = messages[index];
+    if (messages[index - 1].size() != segment_size || message.size() > segment_size ||
+        total + message.size() > MAX_SEGMENTED_SIZE ||
+        message.mAddress.sin_addr.s_addr != first.mAddress.sin_addr.s_addr ||
+        message.mAddress.sin_port != first.mAddress.sin_port) {
+      break;
+    }
+    total += message.size();
+    index++;
+  }
+  return index - start;
+}
+
+size_t TFTP::SyscallIoBackend::sendMessages(int fd, Message *messages, size_t count) {
+  for (size_t index = 0; index < count; index++) {
+    Message &message = messages[index];
+    mIovs[2 * index] = {message.mData.data(), message.mData.size()};
+    mIovs[2 * index + 1] = {const_cast<uint8_t *>(message.mPayload.mData), message.mPayload.mSize};
+  }
+
+  // one message per run of segments
+  size_t headers = 0;
+  for (size_t index = 0; index < count; headers++) {
+    size_t segments = segmentRun(messages, index, count);
+    mmsghdr &header = mHeaders[headers];
+    header = {};
+    header.msg_hdr.msg_name = &messages[index].mAddress;
+    header.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    header.msg_hdr.msg_iov = &mIovs[2 * index];
+    header.msg_hdr.msg_iovlen = 2 * segments;
+
+#ifdef UDP_SEGMENT
+    if (segments > 1) {
+      header.msg_hdr.msg_control = mControls[headers].mBuffer;
+      header.msg_hdr.msg_controllen = sizeof(mControls[headers].mBuffer);
+      cmsghdr *control = CMSG_FIRSTHDR(&header.msg_hdr);
+      control->cmsg_level = SOL_UDP;
+      control->cmsg_type = UDP_SEGMENT;
+      control->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      auto segment_size = static_cast<uint16_t>(messages[index].size());
+      memcpy(CMSG_DATA(control), &segment_size, sizeof(segment_size));
+    }
+#endif
+    index += segments;
+  }
+
+  ZeroCopySocket *zero_copy = zeroCopySocket(fd);
+  int flags = zero_copy && zero_copy->mEnabled ? MSG_ZEROCOPY : 0;
+
+  size_t header = 0;
+  while (header < headers) {
+    int sent = sendmmsg(fd, &mHeaders[header], headers - header, flags);
+    if (sent <= 0) {
+      int error = sent < 0 ? errno : 0;
+      if (error == EINTR) continue;
+      if (error == ENOBUFS && flags) {
+        // too many sends waiting for completion, the rest is copied
+        flags = 0;
+        continue;
+      }
+
+      size_t first = (mHeaders[header].msg_hdr.msg_iov - mIovs.data()) / 2;
+      if (error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS) {
+        // send buffer is full, the rest waits until the socket has room
+        return first;
+      }
+      if (error == EFAULT) {
+        // payload could not be read, the owner of the socket finds out why
+        fault(fd);
+      } else if (mHeaders[header].msg_hdr.msg_controllen) {
+        if (error == EIO || error == EINVAL || error == EOPNOTSUPP) {
+          // path of this socket rejects segments of this size, e.g. larger than its MTU,
+          // such runs of the socket are sent datagram by datagram, other sockets keep segmenting
+          LOG("UDP segmentation offload failed, falling back to single datagrams on the socket")
+          size_t segment_size = messages[first].size();
+          auto limit = mSegmentLimits.try_emplace(fd, segment_size).first;
+          limit->second = std::min(limit->second, segment_size);
+          return first + sendMessages(fd, messages + first, count - first);
+        }
+
+        // e.g. EMSGSIZE from message larger than the send buffer, only its datagrams are sent one by one
+        size_t segments = mHeaders[header].msg_hdr.msg_iovlen / 2;
+        mSegmentation = false;
+        size_t handled = sendMessages(fd, messages + first, segments);
+        mSegmentation = true;
+        if (handled < segments) return first + handled;
+        return first + segments + sendMessages(fd, messages + first + segments, count - first - segments);
+      }
+      // message that failed is dropped as lost packet, same as failed sendto
+      sent = 1;
+    } else {
+      uint64_t datagrams = 0;
+      for (int i = 0; i < sent; i++) {
+        msghdr &message = mHeaders[header + i].msg_hdr;
+        datagrams += message.msg_iovlen / 2;
+
+        // every message is single zero-copy send, its buffers are kept until the kernel releases them
+        if (flags) {
+          auto &pinned = zero_copy->mPinned[zero_copy->mNextId++];
+          size_t first = (message.msg_iov - mIovs.data()) / 2;
+          for (size_t index = first; index < first + message.msg_iovlen / 2; index++) {
+            pinned.push_back(std::move(messages[index]));
+          }
+        }
+      }
+      mSendCounters.add(datagrams);
+    }
+    header += sent;
+  }
+  return count;
+}
+
+void TFTP::SyscallIoBackend::hold(Message &&message) {
+  auto &held = mHeld[message.mFd];
+  if (held.size() < MAX_HELD) held.push_back(std::move(message));
+}
+
+void TFTP::SyscallIoBackend::flush() {
+  // held datagrams go first, so datagrams of one socket keep their order
+  for (auto it = mHeld.begin(); it != mHeld.end();) {
+    auto &held = it->second;
+    size_t done = 0;
+    while (done < held.size()) {
+      size_t count = std::min(held.size() - done, BATCH);
+      size_t handled = sendMessages(it->first, &held[done], count);
+      done += handled;
+      if (handled < count) break;
+    }
+    held.erase(held.begin(), held.begin() + static_cast<std::ptrdiff_t>(done));
+    it = held.empty() ? mHeld.erase(it) : std::next(it);
+  }
+
+  size_t start = 0;
+  while (start < mQueued) {
+    int fd = mQueue[start].mFd;
+    size_t end = start;
+    while (end < mQueued && mQueue[end].mFd == fd) end++;
+
+    size_t handled = mHeld.contains(fd) ? 0 : sendMessages(fd, &mQueue[start], end - start);
+    for (size_t index = start + handled; index < end; index++) hold(std::move(mQueue[index]));
+    start = end;
+  }
+
+  // payload owners are released right away, not when the slot is reused
+  for (size_t i = 0; i < mQueued; i++) mQueue[i].mPayload = {};
+  mQueued = 0;
+
+  for (auto it = mClosing.begin(); it != mClosing.end();) {
+    ZeroCopySocket &socket = mZeroCopySockets[*it];
+    releaseCompleted(*it, socket);
+    if (socket.mPinned.empty()) {
+      ::close(*it);
+      mZeroCopySockets.erase(*it);
+      it = mClosing.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+TFTP::SyscallIoBackend::ZeroCopySocket *TFTP::SyscallIoBackend::zeroCopySocket(int fd) {
+  if (!mZeroCopy) return nullptr;
+
+  auto [it, inserted] = mZeroCopySockets.try_emplace(fd);
+#ifdef SO_ZEROCOPY
+  if (inserted) {
+    int enable = 1;
+    it->second.mEnabled = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == 0;
+  }
+#endif
+  return &it->second;
+}
+
+void TFTP::SyscallIoBackend::releaseCompleted(int fd, ZeroCopySocket &socket) {
+#if __has_include(<linux/errqueue.h>)
+  while (!socket.mPinned.empty()) {
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in))];
+    msghdr message = {};
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+
+    for (cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+      if (cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) continue;
+
+      sock_extended_err error;
+      memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+      if (error.ee_errno != 0 || error.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+      // notification covers sends from ee_info to ee_data inclusive
+      for (uint32_t id = error.ee_info;; id++) {
+        socket.mPinned.erase(id);
+        if (id == error.ee_data) break;
+      }
+    }
+  }
+#endif
+}
+
+std::vector<int> TFTP::SyscallIoBackend::getBlocked() const {
+  std::vector<int> blocked;
+  for (auto &[fd, held]: mHeld) blocked.push_back(fd);
+  return blocked;
+}
+
+void TFTP::SyscallIoBackend::reapCompletions(int fd) {
+  auto it = mZeroCopySockets.find(fd);
+  if (it != mZeroCopySockets.end() && !it->second.mPinned.empty()) releaseCompleted(fd, it->second);
+}
+
+void TFTP::SyscallIoBackend::close(int fd) {
+  flush();
+  // datagrams the socket could not take are lost with it
+  mHeld.erase(fd);
+  mSegmentLimits.erase(fd);
+
+  auto it = mZeroCopySockets.find(fd);
+  if (it == mZeroCopySockets.end()) {
+    ::close(fd);
+    return;
+  }
+
+  releaseCompleted(fd, it->second);
+  if (it->second.mPinned.empty()) {
+    ::close(fd);
+    mZeroCopySockets.erase(it);
+  } else if (!it->second.mClosing) {
+    it->second.mClosing = true;
+    mClosing.push_back(fd);
+  }
+}
+
+TFTP::SyscallIoBackend::~SyscallIoBackend() {
+  flush();
+
+  // pending completions normally arrive within milliseconds, sockets are closed regardless after a while
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (!mClosing.empty() && std::chrono::steady_clock::now() < deadline) {
+    std::vector<pollfd> descriptors;
+    for (int fd: mClosing) descriptors.push_back({fd, 0, 0});
+    poll(descriptors.data(), descriptors.size(), 10);
+    flush();
+  }
+
+  for (int fd: mClosing) ::close(fd);
+}
+
+ssize_t TFTP::SyscallIoBackend::receive(int fd, uint8_t *buffer, size_t size, sockaddr_in &address, int timeout) {
+  flush();
+
+  if (timeout >= 0) {
+    pollfd descriptor = {fd, POLLIN, 0};
+    int ready = poll(&descriptor, 1, timeout);
+    if (ready < 0) return -1;
+    if (ready == 0) {
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+
+  socklen_t address_length = sizeof(address);
+  return recvfrom(fd, buffer, size, 0, (struct sockaddr *) &address, &address_length);
+}
+
+#ifdef IO_URING_SUPPORTED
+
+TFTP::UringIoBackend::UringIoBackend() : mRing(ENTRIES), mSlots(ENTRIES) {
+  for (uint32_t i = ENTRIES; i > 0; i--) {
+    mFreeSlots.push_back(i - 1);
+  }
+}
+
+TFTP::UringIoBackend::~UringIoBackend() {
+  if (!mRing.is_open()) return;
+
+  // receive abandoned by interrupted wait might never complete on its own
+  if (mAbandonedReceive != NO_RECEIVE) {
+    io_uring_sqe *sqe = acquireSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = mAbandonedReceive;
+    sqe->user_data = NO_RECEIVE;
+  }
+
+  // kernel may still access the slots, wait until everything completes
+  while (mFreeSlots.size() != mSlots.size()) {
+    if (submit(1) < 0 && errno != EINTR) break;
+    reap();
+  }
+}
+
+uint32_t TFTP::UringIoBackend::acquireSlot() {
+  reap();
+  while (mFreeSlots.empty()) {
+    submit(1);
+    reap();
+  }
+
+  uint32_t index = mFreeSlots.back();
+  mFreeSlots.pop_back();
+  return index;
+}
+
+io_uring_sqe *TFTP::UringIoBackend::acquireSqe() {
+  io_uring_sqe *sqe = mRing.getSqe();
+  while (sqe == nullptr) {
+    submit();
+    sqe = mRing.getSqe();
+  }
+  return sqe;
+}
+
+void TFTP::UringIoBackend::reap() {
+  mRing.forEachCompletion([this](uint64_t user_data, int32_t result) {
+    if (user_data >= mSlots.size()) return;
+
+    if (user_data == mReceiveSlot) {
+      mReceiveDone = true;
+      mReceiveResult = result;
+      return;
+    }
+    if (user_data == mAbandonedReceive) mAbandonedReceive = NO_RECEIVE;
+    if (result == -EFAULT) fault(mSlots[user_data].mFd);
+    mSlots[user_data].mPayload = {};
+    mFreeSlots.push_back(static_cast<uint32_t>(user_data));
+  });
+}
+
+int TFTP::UringIoBackend::submit(unsigned wait_nr) {
+  int result = mRing.submit(wait_nr);
+  if (result >= 0 && mUnsubmitted) {
+    mSendCounters.add(mUnsubmitted);
+    mUnsubmitted = 0;
+  }
+  return result;
+}
+
+std::span<uint8_t> TFTP::UringIoBackend::queue(int fd, size_t size, SharedBytes payload, const sockaddr_in &address) {
+  uint32_t index = acquireSlot();
+  Slot &slot = mSlots[index];
+
+  slot.mFd = fd;
+  slot.mData.resize(size);
+  slot.mPayload = std::move(payload);
+  slot.mAddress = address;
+  slot.mIovs[0] = {slot.mData.data(), slot.mData.size()};
+  slot.mIovs[1] = {const_cast<uint8_t *>(slot.mPayload.mData), slot.mPayload.mSize};
+  slot.mMsg = {};
+  slot.mMsg.msg_name = &slot.mAddress;
+  slot.mMsg.msg_namelen = sizeof(slot.mAddress);
+  slot.mMsg.msg_iov = slot.mIovs;
+  slot.mMsg.msg_iovlen = 2;
+
+  io_uring_sqe *sqe = acquireSqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&slot.mMsg);
+  sqe->len = 1;
+  sqe->user_data = index;
+  mUnsubmitted++;
+  return slot.mData;
+}
+
+ssize_t TFTP::UringIoBackend::receive(int fd, uint8_t *buffer, size_t size, sockaddr_in &address, int timeout) {
+  uint32_t index = acquireSlot();
+  Slot &slot = mSlots[index];
+
+  slot.mData.resize(size);
+  slot.mAddress = {};
+  slot.mIovs[0] = {slot.mData.data(), size};
+  slot.mMsg = {};
+  slot.mMsg.msg_name = &slot.mAddress;
+  slot.mMsg.msg_namelen = sizeof(slot.mAddress);
+  slot.mMsg.msg_iov = slot.mIovs;
+  slot.mMsg.msg_iovlen = 1;
+
+  // receive and its timeout have to be submitted together, otherwise the link is broken
+  if (timeout >= 0 && mRing.available() < 2) submit();
+
+  io_uring_sqe *sqe = acquireSqe();
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&slot.mMsg);
+  sqe->len = 1;
+  sqe->user_data = index;
+
+  if (timeout >= 0) {
+    sqe->flags = IOSQE_IO_LINK;
+
+    mReceiveTimeout.tv_sec = timeout / 1000;
+    mReceiveTimeout.tv_nsec = (timeout % 1000) * 1000000l;
+    io_uring_sqe *timeout_sqe = acquireSqe();
+    timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+    timeout_sqe->addr = reinterpret_cast<uint64_t>(&mReceiveTimeout);
+    timeout_sqe->len = 1;
+    timeout_sqe->user_data = NO_RECEIVE;
+  }
+
+  mReceiveSlot = index;
+  mReceiveDone = false;
+
+  // queued sends and the receive are submitted by the same syscall
+  while (!mReceiveDone) {
+    if (submit(1) < 0 && errno == EINTR) {
+      reap();
+      if (mReceiveDone) break;
+      // slot is freed once the kernel completes the receive
+      mAbandonedReceive = mReceiveSlot;
+      mReceiveSlot = NO_RECEIVE;
+      errno = EINTR;
+      return -1;
+    }
+    reap();
+  }
+
+  mReceiveSlot = NO_RECEIVE;
+  mFreeSlots.push_back(index);
+
+  if (mReceiveResult < 0) {
+    // receive cancelled by its linked timeout
+    errno = mReceiveResult == -ECANCELED ? EAGAIN : -mReceiveResult;
+    return -1;
+  }
+
+  memcpy(buffer, slot.mData.data(), mReceiveResult);
+  address = slot.mAddress;
+  return mReceiveResult;
+}
+
+void TFTP::UringIoBackend::flush() {
+  submit();
+  reap();
+}
+
+#endif
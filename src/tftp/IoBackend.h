@@ -0,0 +1,362 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_IOBACKEND_H
+#define ISA_PROJECT_IOBACKEND_H
+
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "../utils/IoUring.h"
+#include "../utils/SharedBytes.h"
+
+namespace TFTP {
+  /**
+   * @brief Counts syscalls and datagrams they carried
+   */
+  struct BatchCounters {
+    uint64_t mCalls = 0;
+    uint64_t mDatagrams = 0;
+
+    /**
+     * @brief Records single syscall
+     * @param datagrams number of datagrams passed by the syscall
+     */
+    void add(uint64_t datagrams) {
+      mCalls++;
+      mDatagrams += datagrams;
+    }
+
+    BatchCounters &operator+=(const BatchCounters &other) {
+      mCalls += other.mCalls;
+      mDatagrams += other.mDatagrams;
+      return *this;
+    }
+
+    /**
+     * @return average number of datagrams per syscall
+     */
+    [[nodiscard]] double average() const { return mCalls ? static_cast<double>(mDatagrams) / mCalls : 0; }
+  };
+
+  /**
+   * @brief Interface for sending and receiving datagrams on sockets
+   */
+  class IoBackend {
+  protected:
+    BatchCounters mSendCounters;
+    // sockets whose datagram the kernel could not read, until the caller takes them
+    std::vector<int> mFaulted;
+
+    /**
+     * @brief Records socket whose datagram was dropped with EFAULT
+     * @param fd socket
+     */
+    void fault(int fd) {
+      if (std::find(mFaulted.begin(), mFaulted.end(), fd) == mFaulted.end()) mFaulted.push_back(fd);
+    }
+
+  public:
+    virtual ~IoBackend() = default;
+
+    /**
+     * @brief Queues datagram made of header written by the caller followed by borrowed payload, the header
+     * is written into buffer owned by the backend and reused by later datagrams, so nothing is allocated
+     * once the buffers have grown, sending may be deferred until flush()
+     * @param fd socket to send from
+     * @param size size of the header
+     * @param payload rest of the datagram, its owner is kept by the backend until it is sent
+     * @param address destination address
+     * @return buffer for the header, it has to be filled before the backend is used again
+     */
+    virtual std::span<uint8_t> queue(int fd, size_t size, SharedBytes payload, const sockaddr_in &address) = 0;
+
+    /**
+     * @brief Sends datagram made of header followed by borrowed payload, without copying the payload,
+     * sending may be deferred until flush()
+     * @param fd socket to send from
+     * @param header start of the datagram
+     * @param payload rest of the datagram, its owner is kept by the backend until it is sent
+     * @param address destination address
+     */
+    void send(int fd, const std::vector<uint8_t> &header, SharedBytes payload, const sockaddr_in &address) {
+      std::copy(header.begin(), header.end(), queue(fd, header.size(), std::move(payload), address).begin());
+    }
+
+    /**
+     * @brief Sends datagram, sending may be deferred until flush()
+     * @param fd socket to send from
+     * @param data datagram to be sent
+     * @param address destination address
+     */
+    void send(int fd, const std::vector<uint8_t> &data, const sockaddr_in &address) {
+      send(fd, data, SharedBytes{}, address);
+    }
+
+    /**
+     * @brief Receives single datagram, blocks if the socket is blocking, deferred sends are flushed first
+     * @param fd socket to receive from
+     * @param buffer buffer to receive into
+     * @param size size of the buffer
+     * @param address source address of the datagram
+     * @param timeout milliseconds to wait for the datagram, -1 waits without limit
+     * @return number of received bytes, -1 on error with errno set, EAGAIN if the timeout expired
+     */
+    virtual ssize_t receive(int fd, uint8_t *buffer, size_t size, sockaddr_in &address, int timeout) = 0;
+
+    /**
+     * @brief Passes all deferred operations to the kernel
+     */
+    virtual void flush() {}
+
+    /**
+     * @return sockets with datagrams held back until their send buffer has room, flush() retries them,
+     * the caller should wait for these sockets to become writable
+     */
+    [[nodiscard]] virtual std::vector<int> getBlocked() const { return {}; }
+
+    /**
+     * @brief Takes sockets whose datagram was dropped because the kernel could not read its payload,
+     * e.g. part of mapped file truncated meanwhile
+     * @return sockets reported since the last call
+     */
+    std::vector<int> takeFaulted() {
+      std::vector<int> faulted;
+      faulted.swap(mFaulted);
+      return faulted;
+    }
+
+    /**
+     * @brief Consumes send completions reported on the socket, called when the socket signals an event
+     * @param fd socket to check
+     */
+    virtual void reapCompletions([[maybe_unused]] int fd) {}
+
+    /**
+     * @brief Flushes deferred sends and closes the socket, closing may be postponed while the kernel
+     * still uses buffers sent from it
+     * @param fd socket to be closed
+     */
+    virtual void close(int fd);
+
+    /**
+     * @return counters of syscalls used to send datagrams
+     */
+    [[nodiscard]] const BatchCounters &getSendCounters() const { return mSendCounters; }
+
+    /**
+     * @brief Creates io backend
+     * @param uring whether io_uring should be used, falls back to plain syscalls if it is not available
+     * @param zero_copy whether datagrams should be sent with MSG_ZEROCOPY, supported by the syscall backend
+     * @return created backend
+     */
+    static std::unique_ptr<IoBackend> create(bool uring, bool zero_copy);
+  };
+
+  /**
+   * @brief Backend queueing datagrams until flush, then sending them by sendmmsg, one call per run of
+   * datagrams from the same socket, receive waits by poll and calls recvfrom,
+   * consecutive equally sized datagrams for the same address are passed as single UDP_SEGMENT (GSO) message,
+   * in zero-copy mode buffers stay pinned until the kernel reports their completion on the socket error queue,
+   * datagrams the full send buffer did not take are held in order and retried by later flushes
+   */
+  class SyscallIoBackend final : public IoBackend {
+    /**
+     * @brief Queued datagram
+     */
+    struct Message {
+      int mFd;
+      std::vector<uint8_t> mData;
+      SharedBytes mPayload;
+      sockaddr_in mAddress;
+
+      /**
+       * @return size of the datagram
+       */
+      [[nodiscard]] size_t size() const { return mData.size() + mPayload.mSize; }
+    };
+
+    /**
+     * @brief Zero-copy state of single socket
+     */
+    struct ZeroCopySocket {
+      // false if the kernel refused SO_ZEROCOPY
+      bool mEnabled = false;
+      // id of the next zero-copy send, assigned by the kernel in the same order
+      uint32_t mNextId = 0;
+      // datagrams the kernel may still read, by id of the send
+      std::map<uint32_t, std::vector<Message>> mPinned;
+      // socket is closed once all its buffers are released
+      bool mClosing = false;
+    };
+
+    /**
+     * @brief Control message carrying the segment size
+     */
+    struct Control {
+      alignas(cmsghdr) char mBuffer[CMSG_SPACE(sizeof(uint16_t))];
+    };
+
+    static constexpr size_t BATCH = 64;
+    // kernel limits of single segmented send
+    static constexpr size_t MAX_SEGMENTS = 64;
+    static constexpr size_t MAX_SEGMENTED_SIZE = 65507;
+    // datagrams held back per socket, later ones are dropped as lost, the sender retransmits them anyway
+    static constexpr size_t MAX_HELD = 4 * BATCH;
+
+    std::vector<Message> mQueue;
+    size_t mQueued = 0;
+    std::vector<mmsghdr> mHeaders;
+    // two per datagram, header and payload
+    std::vector<iovec> mIovs;
+    std::vector<Control> mControls;
+    // kernel supports segmented send
+    bool mSegmentation = false;
+    // smallest segment size the path of the socket rejected, e.g. larger than its MTU, such runs are sent singly
+    std::unordered_map<int, size_t> mSegmentLimits;
+    // datagrams waiting for room in the send buffer of their socket, in order
+    std::unordered_map<int, std::vector<Message>> mHeld;
+
+    bool mZeroCopy;
+    std::unordered_map<int, ZeroCopySocket> mZeroCopySockets;
+    // closed sockets still waiting for completions
+    std::vector<int> mClosing;
+
+    /**
+     * @brief Gets zero-copy state of the socket, enables SO_ZEROCOPY on first use
+     * @param fd socket
+     * @return zero-copy state, nullptr if zero-copy mode is off
+     */
+    ZeroCopySocket *zeroCopySocket(int fd);
+
+    /**
+     * @brief Consumes completions from the socket error queue and releases finished buffers
+     * @param fd socket
+     * @param socket zero-copy state of the socket
+     */
+    void releaseCompleted(int fd, ZeroCopySocket &socket);
+
+    /**
+     * @brief Counts datagrams that can be sent as segments of single message, segments the path of the socket
+     * rejected before are not combined
+     * @param messages datagrams from the same socket
+     * @param start index of the first datagram
+     * @param end index after the last datagram
+     * @return number of datagrams, at least 1
+     */
+    [[nodiscard]] size_t segmentRun(const Message *messages, size_t start, size_t end) const;
+
+    /**
+     * @brief Sends datagrams from single socket, datagrams the kernel rejects are dropped as lost packets
+     * @param fd socket to send from
+     * @param messages datagrams to be sent, zero-copy sends take their buffers
+     * @param count number of datagrams, at most BATCH
+     * @return number of datagrams sent or dropped, the rest did not fit into the send buffer
+     */
+    size_t sendMessages(int fd, Message *messages, size_t count);
+
+    /**
+     * @brief Holds datagram until its socket has room
+     * @param message datagram that did not fit into the send buffer
+     */
+    void hold(Message &&message);
+
+  public:
+    /**
+     * @brief SyscallIoBackend constructor
+     * @param zero_copy whether datagrams should be sent with MSG_ZEROCOPY
+     */
+    explicit SyscallIoBackend(bool zero_copy);
+    ~SyscallIoBackend() override;
+
+    std::span<uint8_t> queue(int fd, size_t size, SharedBytes payload, const sockaddr_in &address) override;
+    ssize_t receive(int fd, uint8_t *buffer, size_t size, sockaddr_in &address, int timeout) override;
+    void flush() override;
+    [[nodiscard]] std::vector<int> getBlocked() const override;
+    void reapCompletions(int fd) override;
+    void close(int fd) override;
+  };
+
+#ifdef IO_URING_SUPPORTED
+  /**
+   * @brief Backend queueing datagrams to io_uring, all sends queued between flushes
+   * are passed to the kernel by single syscall, receive is submitted together with them,
+   * its timeout is linked to it
+   */
+  class UringIoBackend final : public IoBackend {
+    /**
+     * @brief Buffer and message header of single in-flight operation
+     */
+    struct Slot {
+      int mFd;
+      std::vector<uint8_t> mData;
+      SharedBytes mPayload;
+      sockaddr_in mAddress;
+      iovec mIovs[2];
+      msghdr mMsg;
+    };
+
+    static constexpr unsigned ENTRIES = 256;
+    static constexpr uint64_t NO_RECEIVE = ~0ull;
+
+    IoUring mRing;
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+
+    // sends queued since last submit
+    uint64_t mUnsubmitted = 0;
+    uint64_t mReceiveSlot = NO_RECEIVE;
+    uint64_t mAbandonedReceive = NO_RECEIVE;
+    bool mReceiveDone = false;
+    int32_t mReceiveResult = 0;
+    // read by the kernel when the linked timeout is submitted
+    __kernel_timespec mReceiveTimeout{};
+
+    /**
+     * @brief Gets free slot, waits for in-flight operations if there is none
+     * @return index of the slot
+     */
+    uint32_t acquireSlot();
+
+    /**
+     * @brief Gets submission queue entry, submits queued entries if the queue is full
+     * @return submission queue entry
+     */
+    io_uring_sqe *acquireSqe();
+
+    /**
+     * @brief Consumes completions and frees slots of finished operations
+     */
+    void reap();
+
+    /**
+     * @brief Submits queued entries
+     * @param wait_nr number of completions to wait for
+     * @return result of IoUring::submit
+     */
+    int submit(unsigned wait_nr = 0);
+
+  public:
+    UringIoBackend();
+    ~UringIoBackend() override;
+
+    /**
+     * @return true if io_uring is available
+     */
+    [[nodiscard]] bool is_open() const { return mRing.is_open(); }
+
+    std::span<uint8_t> queue(int fd, size_t size, SharedBytes payload, const sockaddr_in &address) override;
+    ssize_t receive(int fd, uint8_t *buffer, size_t size, sockaddr_in &address, int timeout) override;
+    void flush() override;
+  };
+#endif
+}// namespace TFTP
+
+#endif//ISA_PROJECT_IOBACKEND_H
@@ -2,271 +2,148 @@
 
 #include "Packet.h"
 
-std::unique_ptr<TFTP::Packet> TFTP::Packet::deserialize(const std::vector<uint8_t> &data) {
-  if (data.size() < 2) throw TFTP::PacketFormatException();
-  uint16_t opcode = (data[0] << 8) | data[1];
-
-  try {
-    switch (opcode) {
-      case 1:
-        return RRQPacket::deserializeFromData(data);
-      case 2:
-        return WRQPacket::deserializeFromData(data);
-      case 3:
-        return TFTP::DataPacket::deserializeFromData(data);
-      case 4:
-        return TFTP::ACKPacket::deserializeFromData(data);
-      case 5:
-        return TFTP::ErrorPacket::deserializeFromData(data);
-      case 6:
-        return TFTP::OACKPacket::deserializeFromData(data);
-      default:
-        throw TFTP::PacketFormatException();
-    }
-  } catch (TFTP::PacketFormatException &e) {
-    throw e;
-  }
-}
-
-std::vector<uint8_t> TFTP::RRQPacket::serialize() const {
-  std::vector<uint8_t> output;
-
-  output.push_back(0);
-  output.push_back(1);
-  for (char c: mFilename) {
-    output.push_back(static_cast<uint8_t>(c));
-  }
-
-  output.push_back(0);
-
-  for (char c: mMode) {
-    output.push_back(static_cast<uint8_t>(c));
-  }
-
-  output.push_back(0);
-  auto opts = Options::serialize(mOptions);
-  output.insert(output.end(), opts.begin(), opts.end());
+#include <algorithm>
+
+namespace {
+  /**
+   * @brief Writes 16-bit field in network byte order
+   * @param output where to write
+   * @param value value of the field
+   * @return position after the field
+   */
+  uint8_t *writeField(uint8_t *output, uint16_t value) {
+    output[0] = (value >> 8) & 0xFF;
+    output[1] = value & 0xFF;
+    return output + 2;
+  }
+
+  /**
+   * @brief Writes zero terminated string
+   * @param output where to write
+   * @param value string to be written
+   * @return position after the terminator
+   */
+  uint8_t *writeString(uint8_t *output, const std::string &value) {
+    output = std::copy(value.begin(), value.end(), output);
+    *output = 0;
+    return output + 1;
+  }
+
+  /**
+   * @brief Writes RRQ/WRQ packet
+   * @param buffer buffer of at least requestSize() bytes
+   * @param opcode opcode of the packet
+   * @param filename requested file
+   * @param mode transfer mode
+   * @param options requested options
+   * @return number of written bytes
+   */
+  size_t writeRequest(std::span<uint8_t> buffer, uint16_t opcode, const std::string &filename, const std::string &mode,
+                      const Options::Set &options) {
+    uint8_t *output = writeField(buffer.data(), opcode);
+    output = writeString(output, filename);
+    output = writeString(output, mode);
+    output += Options::serializeInto(options, buffer.subspan(output - buffer.data()));
+    return output - buffer.data();
+  }
+
+  /**
+   * @param filename requested file
+   * @param mode transfer mode
+   * @param options requested options
+   * @return size of serialized RRQ/WRQ packet
+   */
+  size_t requestSize(const std::string &filename, const std::string &mode, const Options::Set &options) {
+    return 2 + filename.size() + 1 + mode.size() + 1 + Options::serializedSize(options);
+  }
+}// namespace
+
+std::vector<uint8_t> TFTP::Packet::serialize() const {
+  std::vector<uint8_t> output(serializedSize());
+  output.resize(serializeInto(output));
   return output;
 }
 
-std::unique_ptr<TFTP::RRQPacket> TFTP::RRQPacket::deserializeFromData(const std::vector<uint8_t> &data) {
-  int idx = 2;
-
-  std::string fname;
-  while (data[idx] && idx < data.size()) {
-    fname += static_cast<char>(data[idx++]);
-  }
-
-  if (idx == data.size()) throw TFTP::PacketFormatException();
-  if (data[idx] != 0) throw TFTP::PacketFormatException();
-
-  idx++;
-  std::string mode;
-  while (data[idx] && idx < data.size()) {
-    mode += static_cast<char>(data[idx++]);
-  }
-  if (idx == data.size()) throw TFTP::PacketFormatException();
-  if (data[idx] != 0) throw TFTP::PacketFormatException();
-
-  idx++;
-  Options::map_t opts;
-  try {
-    opts = Options::parse(data, idx);
-  } catch (Options::InvalidFormatException &e) {
-    throw TFTP::PacketFormatException();
-  }
-  return std::make_unique<RRQPacket>(fname, mode, opts);
+size_t TFTP::RRQPacket::serializedSize() const {
+  return requestSize(mFilename, mMode, mOptions);
 }
 
-std::string TFTP::RRQPacket::formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const {
-  std::string result = "RRQ " + src_ip + ":" + std::to_string(port) + " " + "\"" + mFilename + "\" " + mMode;
-  if (!mOptions.empty()) {
-    result += " " + Options::format(mOptions);
-  }
-  result += "\n";
-  return result;
+size_t TFTP::RRQPacket::serializeInto(std::span<uint8_t> buffer) const {
+  return writeRequest(buffer, 1, mFilename, mMode, mOptions);
 }
 
-std::vector<uint8_t> TFTP::WRQPacket::serialize() const {
-  std::vector<uint8_t> output;
-  output.push_back(0);
-  output.push_back(2);
-  for (char c: mFilename) {
-    output.push_back(static_cast<uint8_t>(c));
-  }
-
-  output.push_back(0);
-
-  for (char c: mMode) {
-    output.push_back(static_cast<uint8_t>(c));
-  }
-
-  output.push_back(0);
-  auto opts = Options::serialize(mOptions);
-  output.insert(output.end(), opts.begin(), opts.end());
-  return output;
+size_t TFTP::WRQPacket::serializedSize() const {
+  return requestSize(mFilename, mMode, mOptions);
 }
 
-std::unique_ptr<TFTP::WRQPacket> TFTP::WRQPacket::deserializeFromData(const std::vector<uint8_t> &data) {
-  int idx = 2;
-  std::string fname;
-  while (data[idx] && idx < data.size()) {
-    fname += static_cast<char>(data[idx++]);
-  }
-
-  if (idx == data.size()) throw TFTP::PacketFormatException();
-  if (data[idx] != 0) throw TFTP::PacketFormatException();
-
-  idx++;
-  std::string mode;
-  while (data[idx] && idx < data.size()) {
-    mode += static_cast<char>(data[idx++]);
-  }
-  if (idx == data.size()) throw TFTP::PacketFormatException();
-  if (data[idx] != 0) throw TFTP::PacketFormatException();
-  idx++;
-
-  Options::map_t opts;
-  try {
-    opts = Options::parse(data, idx);
-  } catch (Options::InvalidFormatException &e) {
-    throw TFTP::PacketFormatException();
-  }
-  return std::make_unique<WRQPacket>(fname, mode, opts);
+size_t TFTP::WRQPacket::serializeInto(std::span<uint8_t> buffer) const {
+  return writeRequest(buffer, 2, mFilename, mMode, mOptions);
 }
 
-std::string TFTP::WRQPacket::formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const {
-  std::string result = "WRQ " + src_ip + ":" + std::to_string(port) + " " + "\"" + mFilename + "\" " + mMode;
-  if (!mOptions.empty()) {
-    result += " " + Options::format(mOptions);
-  }
-  result += "\n";
-  return result;
+std::span<const uint8_t> TFTP::DataPacket::getData() const {
+  if (mShared.mData) return {mShared.mData, mShared.mSize};
+  return mData;
 }
 
-std::vector<uint8_t> TFTP::DataPacket::serialize() const {
-  std::vector<uint8_t> output;
-
-  output.push_back(0);
-  output.push_back(3);
-
-  output.push_back((mBlkNumber >> 8) & 0xFF);
-  output.push_back(mBlkNumber & 0xFF);
-
-  for (uint8_t byte: mData) {
-    output.push_back(byte);
-  }
-
-  return output;
+size_t TFTP::DataPacket::serializedSize() const {
+  if (mSerialized.mData) return mSerialized.mSize;
+  return HEADER_SIZE + (mShared.mData ? mShared.mSize : mData.size());
 }
 
-std::unique_ptr<TFTP::DataPacket> TFTP::DataPacket::deserializeFromData(const std::vector<uint8_t> &data) {
-  if (data.size() < 4) {
-    throw TFTP::PacketFormatException();
+size_t TFTP::DataPacket::serializeInto(std::span<uint8_t> buffer) const {
+  if (mSerialized.mData) {
+    std::copy(mSerialized.mData, mSerialized.mData + mSerialized.mSize, buffer.data());
+    return mSerialized.mSize;
   }
-  uint16_t blockNum = (data[2] << 8) | data[3];
-  std::vector<uint8_t> outData(data.begin() + 4, data.end());
-  return std::make_unique<DataPacket>(blockNum, outData);
-}
-
-std::string TFTP::DataPacket::formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const {
-  std::string result = "DATA " + src_ip + ":" + std::to_string(port) + ":" + std::to_string(dst_port) + " " +
-                       std::to_string(mBlkNumber) + "\n";
-
-  return result;
-}
-
-std::vector<uint8_t> TFTP::ACKPacket::serialize() const {
-  std::vector<uint8_t> output;
-  output.push_back(0);
-  output.push_back(4);
-  output.push_back((mBlkNumber >> 8) & 0xFF);
-  output.push_back(mBlkNumber & 0xFF);
-  return output;
-}
 
-std::unique_ptr<TFTP::ACKPacket> TFTP::ACKPacket::deserializeFromData(const std::vector<uint8_t> &data) {
-  if (data.size() != 4) {
-    throw TFTP::PacketFormatException();
+  uint8_t *output = buffer.data() + serializeHeaderInto(buffer);
+  if (mShared.mData) {
+    output = std::copy(mShared.mData, mShared.mData + mShared.mSize, output);
+  } else {
+    output = std::copy(mData.begin(), mData.end(), output);
   }
 
-  uint16_t blockNum = (data[2] << 8) | data[3];
-  return std::make_unique<ACKPacket>(blockNum);
+  return output - buffer.data();
 }
 
-std::string TFTP::ACKPacket::formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const {
-  std::string result = "ACK " + src_ip + ":" + std::to_string(port) + " " + std::to_string(mBlkNumber) + "\n";
-  return result;
+size_t TFTP::DataPacket::serializeHeaderInto(std::span<uint8_t> buffer) const {
+  writeField(writeField(buffer.data(), 3), mBlkNumber);
+  return HEADER_SIZE;
 }
 
-std::vector<uint8_t> TFTP::ErrorPacket::serialize() const {
-  std::vector<uint8_t> output;
-  output.push_back(0);
-  output.push_back(5);
+TFTP::DataPacket TFTP::DataPacket::fromSerialized(SharedBytes serialized) {
+  uint16_t blockNum = (serialized.mData[2] << 8) | serialized.mData[3];
+  SharedBytes data{serialized.mOwner, serialized.mData + 4, serialized.mSize - 4};
 
-  output.push_back((mErrorCode >> 8) & 0xFF);
-  output.push_back(mErrorCode & 0xFF);
-
-  for (char c: mErrorMessage) {
-    output.push_back(static_cast<uint8_t>(c));
-  }
-
-  output.push_back(0);
-  return output;
+  DataPacket packet(blockNum, std::move(data));
+  packet.mSerialized = std::move(serialized);
+  return packet;
 }
 
-std::unique_ptr<TFTP::ErrorPacket> TFTP::ErrorPacket::deserializeFromData(const std::vector<uint8_t> &data) {
-  if (data.size() < 4) {
-    throw TFTP::PacketFormatException();
-  }
-
-  uint16_t errorCode = (data[2] << 8) | data[3];
-
-  int idx = 4;
-  std::string errorMessage;
-  while (data[idx] && idx < data.size()) {
-    errorMessage += static_cast<char>(data[idx++]);
-  }
-
-  return std::make_unique<ErrorPacket>(errorCode, errorMessage);
+size_t TFTP::ACKPacket::serializedSize() const {
+  return 4;
 }
 
-std::string TFTP::ErrorPacket::formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const {
-  std::string result =
-          "ERROR " + src_ip + ":" + std::to_string(port) + ":" + std::to_string(dst_port) + " " + std::to_string(mErrorCode) + " " + "\"" + mErrorMessage +
-          "\"\n";
-
-  return result;
+size_t TFTP::ACKPacket::serializeInto(std::span<uint8_t> buffer) const {
+  writeField(writeField(buffer.data(), 4), mBlkNumber);
+  return 4;
 }
 
-std::vector<uint8_t> TFTP::OACKPacket::serialize() const {
-  std::vector<uint8_t> output;
-
-  output.push_back(0);
-  output.push_back(6);
-
-  auto opts = Options::serialize(mOptions);
-
-  output.insert(output.end(), opts.begin(), opts.end());
-
-  return output;
+size_t TFTP::ErrorPacket::serializedSize() const {
+  return 4 + mErrorMessage.size() + 1;
 }
 
-std::unique_ptr<TFTP::OACKPacket> TFTP::OACKPacket::deserializeFromData(const std::vector<uint8_t> &data) {
-  int idx = 2;
-
-  Options::map_t opts;
-  try {
-    opts = Options::parse(data, idx);
-  } catch (Options::InvalidFormatException &e) {
-    throw TFTP::PacketFormatException();
-  }
-
-  return std::make_unique<OACKPacket>(opts);
+size_t TFTP::ErrorPacket::serializeInto(std::span<uint8_t> buffer) const {
+  uint8_t *output = writeField(writeField(buffer.data(), 5), mErrorCode);
+  output = writeString(output, mErrorMessage);
+  return output - buffer.data();
 }
 
-std::string TFTP::OACKPacket::formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const {
-  std::string result = "OACK " + src_ip + ":" + std::to_string(port) + " " + Options::format(mOptions) + "\n";
+size_t TFTP::OACKPacket::serializedSize() const {
+  return 2 + Options::serializedSize(mOptions);
+}
 
-  return result;
+size_t TFTP::OACKPacket::serializeInto(std::span<uint8_t> buffer) const {
+  writeField(buffer.data(), 6);
+  return 2 + Options::serializeInto(mOptions, buffer.subspan(2));
 }
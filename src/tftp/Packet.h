@@ -8,11 +8,13 @@
 #include <map>
 #include <memory>
 #include <set>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "../utils/Options.h"
+#include "../utils/SharedBytes.h"
 #include "common.h"
 
 namespace TFTP {
@@ -24,26 +26,22 @@ namespace TFTP {
     virtual ~Packet() = default;
 
     /**
-     * @brief Serializes packet to byte vector
-     * @return Serialized packet
+     * @return size of the serialized packet
      */
-    [[nodiscard]] virtual std::vector<uint8_t> serialize() const = 0;
+    [[nodiscard]] virtual size_t serializedSize() const = 0;
 
     /**
-     * @brief Formats packet to string
-     * @param src_ip ip from where it was received
-     * @param port port from where it was received
-     * @param dst_port port of the destination
-     * @return string representation of the packet
+     * @brief Serializes packet into caller's buffer without allocation
+     * @param buffer buffer of at least serializedSize() bytes
+     * @return number of written bytes
      */
-    [[nodiscard]] virtual std::string formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const = 0;
+    virtual size_t serializeInto(std::span<uint8_t> buffer) const = 0;
 
     /**
-     * @brief Deserializes packet from byte vector
-     * @param data byte vector to deserialize from
-     * @return unique pointer to the deserialized packet, throws exception if packet is invalid
+     * @brief Serializes packet to byte vector
+     * @return Serialized packet
      */
-    static std::unique_ptr<Packet> deserialize(const std::vector<uint8_t> &data);
+    [[nodiscard]] std::vector<uint8_t> serialize() const;
   };
 
   /**
@@ -52,86 +50,114 @@ namespace TFTP {
   class RRQPacket : public Packet {
     std::string mFilename;
     std::string mMode;
-    Options::map_t mOptions;
+    Options::Set mOptions;
 
   public:
-    RRQPacket(std::string filename, std::string mode, Options::map_t opts) : mFilename(std::move(filename)),
+    RRQPacket(std::string filename, std::string mode, Options::Set opts) : mFilename(std::move(filename)),
                                                                              mMode(std::move(mode)),
                                                                              mOptions(std::move(opts)) {}
 
-    [[nodiscard]] std::string formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const override;
-
     [[nodiscard]] std::string getFilename() const { return mFilename; }
 
     [[nodiscard]] std::string getMode() const { return mMode; }
 
     [[nodiscard]] std::string getFormattedOptions() const { return Options::format(mOptions); }
 
-    [[nodiscard]] Options::map_t getOptions() const { return mOptions; }
+    [[nodiscard]] Options::Set getOptions() const { return mOptions; }
 
-    [[nodiscard]] std::vector<uint8_t> serialize() const override;
+    [[nodiscard]] size_t serializedSize() const override;
 
-    static std::unique_ptr<RRQPacket> deserializeFromData(const std::vector<uint8_t> &data);
+    size_t serializeInto(std::span<uint8_t> buffer) const override;
   };
 
   class WRQPacket : public Packet {
     std::string mFilename;
     std::string mMode;
-    Options::map_t mOptions;
+    Options::Set mOptions;
 
   public:
-    WRQPacket(std::string filename, std::string mode, Options::map_t opts) : mFilename(std::move(filename)),
+    WRQPacket(std::string filename, std::string mode, Options::Set opts) : mFilename(std::move(filename)),
                                                                              mMode(std::move(mode)),
                                                                              mOptions(std::move(opts)) {}
 
-    [[nodiscard]] std::string formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const override;
-
     [[nodiscard]] std::string getFilename() const { return mFilename; }
 
     [[nodiscard]] std::string getMode() const { return mMode; }
 
     [[nodiscard]] std::string getFormattedOptions() const { return Options::format(mOptions); }
 
-    [[nodiscard]] Options::map_t getOptions() const { return mOptions; }
+    [[nodiscard]] Options::Set getOptions() const { return mOptions; }
 
-    [[nodiscard]] std::vector<uint8_t> serialize() const override;
+    [[nodiscard]] size_t serializedSize() const override;
 
-    static std::unique_ptr<WRQPacket> deserializeFromData(const std::vector<uint8_t> &data);
+    size_t serializeInto(std::span<uint8_t> buffer) const override;
   };
 
   class OACKPacket : public Packet {
-    Options::map_t mOptions;
+    Options::Set mOptions;
 
   public:
-    explicit OACKPacket(Options::map_t opts) : mOptions(std::move(opts)) {}
-
-    [[nodiscard]] std::string formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const override;
+    explicit OACKPacket(Options::Set opts) : mOptions(std::move(opts)) {}
 
-    [[nodiscard]] Options::map_t getOptions() const { return mOptions; }
+    [[nodiscard]] Options::Set getOptions() const { return mOptions; }
 
     [[nodiscard]] std::string getFormattedOptions() const { return Options::format(mOptions); }
 
-    [[nodiscard]] std::vector<uint8_t> serialize() const override;
+    [[nodiscard]] size_t serializedSize() const override;
 
-    static std::unique_ptr<OACKPacket> deserializeFromData(const std::vector<uint8_t> &data);
+    size_t serializeInto(std::span<uint8_t> buffer) const override;
   };
 
   class DataPacket : public Packet {
     uint16_t mBlkNumber;
     std::vector<uint8_t> mData;
+    // data borrowed from e.g. file mapping, used instead of mData if it is set
+    SharedBytes mShared;
+    // whole packet borrowed already serialized from e.g. block cache, mShared points into it
+    SharedBytes mSerialized;
 
   public:
+    // size of opcode and block number
+    static constexpr size_t HEADER_SIZE = 4;
+
     DataPacket(uint16_t blockNumber, std::vector<uint8_t> data) : mBlkNumber(blockNumber), mData(std::move(data)) {}
 
-    [[nodiscard]] std::string formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const override;
+    DataPacket(uint16_t blockNumber, SharedBytes data) : mBlkNumber(blockNumber), mShared(std::move(data)) {}
 
-    [[nodiscard]] std::vector<uint8_t> getData() const { return mData; }
+    /**
+     * @return view of the data, valid as long as the packet
+     */
+    [[nodiscard]] std::span<const uint8_t> getData() const;
 
     [[nodiscard]] uint16_t getBlockNumber() const { return mBlkNumber; }
 
-    [[nodiscard]] std::vector<uint8_t> serialize() const override;
+    /**
+     * @return borrowed data, empty if the packet owns its data
+     */
+    [[nodiscard]] const SharedBytes &getSharedData() const { return mShared; }
 
-    static std::unique_ptr<DataPacket> deserializeFromData(const std::vector<uint8_t> &data);
+    /**
+     * @return borrowed serialized packet, empty if the packet was not created from one
+     */
+    [[nodiscard]] const SharedBytes &getSerialized() const { return mSerialized; }
+
+    [[nodiscard]] size_t serializedSize() const override;
+
+    size_t serializeInto(std::span<uint8_t> buffer) const override;
+
+    /**
+     * @brief Serializes opcode and block number only, data is sent from getSharedData()
+     * @param buffer buffer of at least HEADER_SIZE bytes
+     * @return number of written bytes
+     */
+    size_t serializeHeaderInto(std::span<uint8_t> buffer) const;
+
+    /**
+     * @brief Creates packet borrowing its serialized form, which is then sent as is
+     * @param serialized serialized data packet
+     * @return packet with data pointing into the serialized packet
+     */
+    static DataPacket fromSerialized(SharedBytes serialized);
   };
 
   class ACKPacket : public Packet {
@@ -140,13 +166,11 @@ namespace TFTP {
   public:
     explicit ACKPacket(uint16_t blockNumber) : mBlkNumber(blockNumber) {}
 
-    [[nodiscard]] std::string formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const override;
-
     [[nodiscard]] uint16_t getBlockNumber() const { return mBlkNumber; }
 
-    [[nodiscard]] std::vector<uint8_t> serialize() const override;
+    [[nodiscard]] size_t serializedSize() const override;
 
-    static std::unique_ptr<ACKPacket> deserializeFromData(const std::vector<uint8_t> &data);
+    size_t serializeInto(std::span<uint8_t> buffer) const override;
   };
 
   class ErrorPacket : public Packet {
@@ -156,17 +180,14 @@ namespace TFTP {
   public:
     ErrorPacket(uint16_t errorCode, std::string errorMsg) : mErrorCode(errorCode), mErrorMessage(std::move(errorMsg)) {}
 
-    [[nodiscard]] std::string formatPacket(std::string src_ip, uint16_t port, uint16_t dst_port) const override;
-
     [[nodiscard]] std::string getErrorCode() const { return std::to_string(mErrorCode); }
 
     [[nodiscard]] std::string getErrorMsg() const { return mErrorMessage; }
 
-    [[nodiscard]] std::vector<uint8_t> serialize() const override;
+    [[nodiscard]] size_t serializedSize() const override;
 
-    static std::unique_ptr<ErrorPacket> deserializeFromData(const std::vector<uint8_t> &data);
+    size_t serializeInto(std::span<uint8_t> buffer) const override;
   };
 }// namespace TFTP
 
-
 #endif//ISA_PROJECT_PACKET_H
@@ -0,0 +1,107 @@
+// Matej Sirovatka, xsirov00
+
+#include "PacketView.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace {
+  /**
+   * @brief Reads zero terminated string and advances the data past the terminator
+   * @param data remaining data
+   * @return view of the string, throws PacketFormatException if there is no terminator
+   */
+  std::string_view readString(std::span<const uint8_t> &data) {
+    auto end = std::find(data.begin(), data.end(), 0);
+    if (end == data.end()) throw TFTP::PacketFormatException();
+
+    std::string_view result(reinterpret_cast<const char *>(data.data()), end - data.begin());
+    data = data.subspan(result.size() + 1);
+    return result;
+  }
+
+  /**
+   * @brief Checks that options consist of zero terminated key and value pairs, same as Options::parse requires
+   * @param data serialized options
+   */
+  void checkOptions(std::span<const uint8_t> data) {
+    if (data.empty()) return;
+    if (data.back() != 0 || std::count(data.begin(), data.end(), 0) % 2 != 0) throw TFTP::PacketFormatException();
+  }
+
+  /**
+   * @param data datagram of at least 4 bytes
+   * @return second 16-bit field of the packet
+   */
+  uint16_t readField(std::span<const uint8_t> data) {
+    return static_cast<uint16_t>((data[2] << 8) | data[3]);
+  }
+
+  template<typename T>
+  T parseRequest(std::span<const uint8_t> data) {
+    T request;
+    request.mFilename = readString(data);
+    request.mMode = readString(data);
+    checkOptions(data);
+    request.mOptions = data;
+    return request;
+  }
+}// namespace
+
+TFTP::PacketView TFTP::parsePacket(std::span<const uint8_t> datagram) {
+  if (datagram.size() < 2) throw TFTP::PacketFormatException();
+  uint16_t opcode = (datagram[0] << 8) | datagram[1];
+
+  switch (opcode) {
+    case 1:
+      return parseRequest<RRQView>(datagram.subspan(2));
+    case 2:
+      return parseRequest<WRQView>(datagram.subspan(2));
+    case 3:
+      if (datagram.size() < 4) throw TFTP::PacketFormatException();
+      return DataView{readField(datagram), datagram.subspan(4)};
+    case 4:
+      if (datagram.size() != 4) throw TFTP::PacketFormatException();
+      return ACKView{readField(datagram)};
+    case 5: {
+      if (datagram.size() < 4) throw TFTP::PacketFormatException();
+      // message without terminator is accepted as a whole
+      auto message = datagram.subspan(4);
+      auto end = std::find(message.begin(), message.end(), 0);
+      return ErrorView{readField(datagram),
+                       std::string_view(reinterpret_cast<const char *>(message.data()), end - message.begin())};
+    }
+    case 6:
+      checkOptions(datagram.subspan(2));
+      return OACKView{datagram.subspan(2)};
+    default:
+      throw TFTP::PacketFormatException();
+  }
+}
+
+void TFTP::printPacket(std::ostream &os, const PacketView &packet, const char *src_ip, uint16_t port, uint16_t dst_port) {
+  char line[96];
+  int length = 0;
+
+  if (auto data = std::get_if<DataView>(&packet)) {
+    length = snprintf(line, sizeof(line), "DATA %s:%u:%u %u\n", src_ip, port, dst_port, data->mBlockNumber);
+  } else if (auto ack = std::get_if<ACKView>(&packet)) {
+    length = snprintf(line, sizeof(line), "ACK %s:%u %u\n", src_ip, port, ack->mBlockNumber);
+  } else if (auto error = std::get_if<ErrorView>(&packet)) {
+    os << "ERROR " + std::string(src_ip) + ":" + std::to_string(port) + ":" + std::to_string(dst_port) + " " +
+                  std::to_string(error->mErrorCode) + " \"" + std::string(error->mMessage) + "\"\n";
+  } else if (auto oack = std::get_if<OACKView>(&packet)) {
+    os << "OACK " + std::string(src_ip) + ":" + std::to_string(port) + " " + Options::format(oack->mOptions) + "\n";
+  } else {
+    bool read = std::holds_alternative<RRQView>(packet);
+    auto &request = read ? static_cast<const RequestView &>(std::get<RRQView>(packet)) : std::get<WRQView>(packet);
+    std::string result = std::string(read ? "RRQ " : "WRQ ") + src_ip + ":" + std::to_string(port) + " \"" +
+                         std::string(request.mFilename) + "\" " + std::string(request.mMode);
+    if (!request.mOptions.empty()) result += " " + Options::format(request.mOptions);
+    os << result + "\n";
+  }
+
+  // hot packets are written at once, stderr is not buffered
+  if (length > 0) os.write(line, std::min(length, static_cast<int>(sizeof(line)) - 1));
+}
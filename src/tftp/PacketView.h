@@ -0,0 +1,80 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_PACKETVIEW_H
+#define ISA_PROJECT_PACKETVIEW_H
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <variant>
+
+#include "../utils/Options.h"
+#include "common.h"
+
+namespace TFTP {
+  /**
+   * @brief Fields of RRQ/WRQ packet, all views point into the parsed datagram
+   */
+  struct RequestView {
+    std::string_view mFilename;
+    std::string_view mMode;
+    std::span<const uint8_t> mOptions;
+
+    /**
+     * @return parsed and validated options
+     */
+    [[nodiscard]] Options::Set getOptions() const { return Options::parse(mOptions); }
+  };
+
+  struct RRQView : RequestView {};
+
+  struct WRQView : RequestView {};
+
+  struct DataView {
+    uint16_t mBlockNumber;
+    std::span<const uint8_t> mData;
+  };
+
+  struct ACKView {
+    uint16_t mBlockNumber;
+  };
+
+  struct ErrorView {
+    uint16_t mErrorCode;
+    std::string_view mMessage;
+  };
+
+  struct OACKView {
+    std::span<const uint8_t> mOptions;
+
+    /**
+     * @return parsed and validated options
+     */
+    [[nodiscard]] Options::Set getOptions() const { return Options::parse(mOptions); }
+  };
+
+  /**
+   * @brief Packet parsed in place, it does not own any data and is valid only as long as the parsed datagram
+   */
+  using PacketView = std::variant<RRQView, WRQView, DataView, ACKView, ErrorView, OACKView>;
+
+  /**
+   * @brief Parses datagram without copying it
+   * @param datagram received datagram
+   * @return view of the packet, throws PacketFormatException if the packet is invalid
+   */
+  PacketView parsePacket(std::span<const uint8_t> datagram);
+
+  /**
+   * @brief Prints packet in the format required by the assignment, DATA and ACK are formatted without allocation
+   * @param os stream to print to
+   * @param packet packet to be printed
+   * @param src_ip ip from where it was received
+   * @param port port from where it was received
+   * @param dst_port port of the destination
+   */
+  void printPacket(std::ostream &os, const PacketView &packet, const char *src_ip, uint16_t port, uint16_t dst_port);
+}// namespace TFTP
+
+#endif//ISA_PROJECT_PACKETVIEW_H
@@ -8,10 +8,10 @@ void ServerSigintHandler(int signum) {
   runningServer = 0;
 }
 
-TFTP::Server::Server(const ServerArgs &args) {
-  mMainSocketFd = socket(AF_INET, SOCK_DGRAM, 0);
-  mRootDir = args.mRootDir;
-
+TFTP::Server::Server(const ServerArgs &args) : mTransfers(args.mMaxTransfers, args.mMaxPending),
+                                               mCache(args.mCacheSize),
+                                               mBuffers(POOLED_BUFFERS_SIZE),
+                                               mCommit(args.mDurable) {
   struct sigaction sa;
   sa.sa_handler = ServerSigintHandler;
 
@@ -19,103 +19,63 @@ TFTP::Server::Server(const ServerArgs &args) {
   sa.sa_flags = 0;
   sigaction(SIGINT, &sa, NULL);
 
-  mServerAdress = {};
-  memset(&mServerAdress, 0, sizeof(mServerAdress));
-
-  mServerAdress.sin_family = AF_INET;
-  mServerAdress.sin_port = htons(args.mPort);
+  mStatistics = args.mStatistics;
 
-  //  timeval read_timeout{};
-  //  read_timeout.tv_sec = 0;
-  //  read_timeout.tv_usec = 100;
-  //  setsockopt(mMainSocketFd, SOL_SOCKET, SO_RCVTIMEO, &read_timeout, sizeof read_timeout);
+  uint32_t workers = args.mWorkers;
+  if (workers == 0) workers = std::max(std::thread::hardware_concurrency(), 1u);
 
-  bind(mMainSocketFd, reinterpret_cast<sockaddr *>(&mServerAdress), sizeof(mServerAdress));
+  // Kernel distributes requests between the sockets of all workers
+  for (uint32_t i = 0; i < workers; i++) {
+    mWorkers.push_back(std::make_unique<Worker>(args, mTransfers, mCache, mBuffers, mCommit, workers > 1));
+  }
 }
 
 void TFTP::Server::listen() {
-  while (runningServer) {
-    std::vector<uint8_t> buffer(65535);
-
-    sockaddr_in from_address = {};
-    socklen_t from_length = sizeof(from_address);
-
-    ssize_t received = recvfrom(mMainSocketFd, buffer.data(), buffer.size(), 0, (struct sockaddr *) &from_address,
-                                &from_length);
-
-    if (received <= 0) {
-      if (errno == EINTR) {
-        break;
-      } else {
-        continue;
-      }
-    }
-    buffer.resize(received);
-
-    std::unique_ptr<Packet> packet;
-    try {
-      packet = Packet::deserialize(buffer);
-    } catch (TFTP::PacketFormatException &e) {
-      auto error_packet = ErrorPacket{4, "Illegal TFTP operation"}.serialize();
-      sendto(mMainSocketFd, error_packet.data(), error_packet.size(), 0, (struct sockaddr *) &from_address,
-             sizeof(from_address));
-
-      continue;
-    }
-    const auto rrq_packet = dynamic_cast<RRQPacket *>(packet.get());
-    const auto wrq_packet = dynamic_cast<WRQPacket *>(packet.get());
-
-    std::cerr << packet->formatPacket(inet_ntoa(from_address.sin_addr), ntohs(from_address.sin_port),
-                                      ntohs(mServerAdress.sin_port));
-
-    // TODO: error handling
-    std::filesystem::path path{mRootDir};
-    Options::map_t validated_options;
-    if (rrq_packet) {
-      path /= rrq_packet->getFilename();
-      try {
-        validated_options = Options::validate(rrq_packet->getOptions());
-      } catch (Options::InvalidFormatException &e) {
-        auto error_packet = ErrorPacket{4, "Illegal TFTP operation"}.serialize();
-        sendto(mMainSocketFd, error_packet.data(), error_packet.size(), 0, (struct sockaddr *) &from_address,
-               sizeof(from_address));
-        continue;
-      }
-      auto connection = std::make_unique<TFTP::Connection>(path, validated_options,
-                                                           from_address, rrq_packet->getMode());
-      mConnections.push_back(std::move(connection));
-      mThreads.emplace_back(&TFTP::Connection::serveDownload, mConnections.back().get());
-
-    } else if (wrq_packet) {
-      path /= wrq_packet->getFilename();
-      try {
-        validated_options = Options::validate(wrq_packet->getOptions());
-      } catch (Options::InvalidFormatException &e) {
-        auto error_packet = ErrorPacket{4, "Illegal TFTP operation"}.serialize();
-        sendto(mMainSocketFd, error_packet.data(), error_packet.size(), 0, (struct sockaddr *) &from_address,
-               sizeof(from_address));
-        continue;
-      }
-      auto connection = std::make_unique<TFTP::Connection>(path, validated_options,
-                                                           from_address, wrq_packet->getMode());
-      mConnections.push_back(std::move(connection));
-      mThreads.emplace_back(&TFTP::Connection::serveUpload, mConnections.back().get());
-
-    } else {
-      auto error_packet = ErrorPacket{4, "Illegal TFTP operation"}.serialize();
-      sendto(mMainSocketFd, error_packet.data(), error_packet.size(), 0, (struct sockaddr *) &from_address,
-             sizeof(from_address));
-    }
+  // SIGINT is blocked in all threads and delivered only while the main event loop waits for events,
+  // signal arriving while the loop is busy stays pending until its next wait instead of being lost
+  sigset_t mask, old_mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+  for (size_t i = 1; i < mWorkers.size(); i++) {
+    mThreads.emplace_back(&Worker::run, mWorkers[i].get(), nullptr);
+  }
+
+  if (runningServer) mWorkers.front()->run(&old_mask);
+
+  for (size_t i = 1; i < mWorkers.size(); i++) {
+    mWorkers[i]->stop();
+  }
+
+  for (auto &thread: mThreads) {
+    thread.join();
   }
+  mThreads.clear();
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+  if (mStatistics) printStatistics();
 }
 
-TFTP::Server::~Server() {
-  for (auto &connection: mConnections) {
-    connection->cleanup();
+void TFTP::Server::printStatistics() const {
+  BatchCounters requests, sends;
+  for (auto &worker: mWorkers) {
+    requests += worker->getRequestCounters();
+    sends += worker->getSendCounters();
   }
 
-  for (std::thread &thread: mThreads) {
-    pthread_kill(thread.native_handle(), SIGUSR1);
+  std::cerr << "STATS requests " << requests.mDatagrams << " in " << requests.mCalls << " calls (avg "
+            << requests.average() << "), sent " << sends.mDatagrams << " in " << sends.mCalls << " calls (avg "
+            << sends.average() << ")\n";
+  std::cerr << "CACHE hits " << mCache.getHits() << " misses " << mCache.getMisses() << "\n";
+  if (mCommit.isEnabled()) {
+    std::cerr << "COMMIT uploads " << mCommit.getCommits() << " syncs " << mCommit.getSyncs() << "\n";
+  }
+}
+
+TFTP::Server::~Server() {
+  for (auto &worker: mWorkers) {
+    worker->stop();
   }
 
   for (auto &thread: mThreads) {
@@ -7,20 +7,31 @@
 #include <thread>
 
 #include "../utils/ArgParser.h"
-#include "Connection.h"
-#include "Packet.h"
+#include "Worker.h"
 
 namespace TFTP {
   /**
-   * @brief Server class
+   * @brief Server class, runs one or more workers, each with its own listening socket and event loop
    */
   class Server {
-    int mMainSocketFd;
-    sockaddr_in mServerAdress;
-    std::string mRootDir;
-
+    // idle buffers kept for new transfers, everything above is freed
+    static constexpr size_t POOLED_BUFFERS_SIZE = 64 << 20;
+
+    TransferQueue mTransfers;
+    BlockCache mCache;
+    // declared before the workers, buffers are given back to it when the workers are destroyed
+    BufferPool mBuffers;
+    // uploads being committed are waited for by their workers, so it has to outlive them
+    GroupCommit mCommit;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
     std::vector<std::thread> mThreads;
-    std::vector<std::unique_ptr<Connection>> mConnections;
+    bool mStatistics;
+
+    /**
+     * @brief Prints average number of datagrams per syscall of all workers, block cache hit rate
+     * and number of syncs of committed uploads
+     */
+    void printStatistics() const;
 
   public:
     /**
@@ -32,7 +43,7 @@ namespace TFTP {
     ~Server();
 
     /**
-     * @brief Starts listening for incoming connections
+     * @brief Starts listening for incoming connections, returns after SIGINT
      */
     void listen();
   };
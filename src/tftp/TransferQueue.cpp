@@ -0,0 +1,60 @@
+// Matej Sirovatka, xsirov00
+
+#include "TransferQueue.h"
+
+TFTP::TransferQueue::TransferQueue(uint32_t max_transfers, size_t max_pending) : mMaxTransfers(max_transfers),
+                                                                               mMaxPending(max_pending),
+                                                                               mActive(0) {}
+
+void TFTP::TransferQueue::expire(std::chrono::steady_clock::time_point now) {
+  // client backs off between retransmissions of its request, it gives up only after all its retries,
+  // same budget as the idle timer of a running connection
+  std::erase_if(mPending, [now](const TransferRequest &request) {
+    return now - request.mReceivedAt > request.mOptions.getTimeout() * MAX_RETRIES;
+  });
+}
+
+TFTP::TransferQueue::Admission TFTP::TransferQueue::admit(TransferRequest &request) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  if (mMaxTransfers == 0 || mActive < mMaxTransfers) {
+    mActive++;
+    return Admission::START;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  // Retransmitted request of already queued client
+  for (auto &pending: mPending) {
+    if (pending.mClientAddr.sin_port == request.mClientAddr.sin_port &&
+        pending.mClientAddr.sin_addr.s_addr == request.mClientAddr.sin_addr.s_addr) {
+      pending.mReceivedAt = now;
+      return Admission::QUEUED;
+    }
+  }
+
+  // requests of clients which gave up do not take places of waiting ones
+  expire(now);
+  if (mPending.size() >= mMaxPending) {
+    return Admission::REJECTED;
+  }
+
+  request.mReceivedAt = now;
+  mPending.push_back(std::move(request));
+  return Admission::QUEUED;
+}
+
+std::optional<TFTP::TransferRequest> TFTP::TransferQueue::release() {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  expire(std::chrono::steady_clock::now());
+
+  if (mPending.empty()) {
+    mActive--;
+    return std::nullopt;
+  }
+
+  // slot is passed to the queued request
+  auto request = std::move(mPending.front());
+  mPending.pop_front();
+  return request;
+}
@@ -0,0 +1,85 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_TRANSFERQUEUE_H
+#define ISA_PROJECT_TRANSFERQUEUE_H
+
+#include <netinet/in.h>
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "../utils/Options.h"
+#include "../utils/utils.h"
+#include "common.h"
+
+namespace TFTP {
+  /**
+   * @brief Validated request waiting for a transfer to be started
+   */
+  struct TransferRequest {
+    Mode mMode;
+    std::string mFilePath;
+    Options::Set mOptions;
+    sockaddr_in mClientAddr;
+    std::string mTransmissionMode;
+    // when the queued request was last received, retransmissions of the client refresh it
+    std::chrono::steady_clock::time_point mReceivedAt;
+  };
+
+  /**
+   * @brief Limits number of concurrent transfers across all workers, requests over the limit wait
+   * in bounded queue shared by all workers, so the first worker with free slot starts them,
+   * request not retransmitted within the whole retry budget of its client is dropped, as the client gave up on it
+   */
+  class TransferQueue {
+    uint32_t mMaxTransfers;
+    size_t mMaxPending;
+
+    std::mutex mMutex;
+    uint32_t mActive;
+    std::deque<TransferRequest> mPending;
+
+    /**
+     * @brief Drops queued requests whose clients gave up, anywhere in the queue, called under the lock
+     * @param now current time
+     */
+    void expire(std::chrono::steady_clock::time_point now);
+
+  public:
+    /**
+     * @brief Result of admitting new request
+     */
+    enum class Admission {
+      START,
+      QUEUED,
+      REJECTED
+    };
+
+    /**
+     * @brief TransferQueue constructor
+     * @param max_transfers maximum number of concurrent transfers, 0 means unlimited
+     * @param max_pending maximum number of requests waiting for free slot
+     */
+    TransferQueue(uint32_t max_transfers, size_t max_pending);
+
+    /**
+     * @brief Admits new request, takes a slot if there is one free, otherwise tries to queue it
+     * @param request request to be admitted, moved into the queue if it is queued
+     * @return START if caller should start the transfer, QUEUED if it waits in the queue,
+     * REJECTED if the queue is full
+     */
+    Admission admit(TransferRequest &request);
+
+    /**
+     * @brief Releases slot of finished transfer, slot is immediately handed to the oldest queued request
+     * whose client is still waiting, expired requests are dropped
+     * @return request to be started by the caller, nullopt if the queue is empty
+     */
+    std::optional<TransferRequest> release();
+  };
+}// namespace TFTP
+
+#endif//ISA_PROJECT_TRANSFERQUEUE_H
@@ -0,0 +1,308 @@
+// Matej Sirovatka, xsirov00
+
+#include "Worker.h"
+
+TFTP::Worker::Worker(const ServerArgs &args, TransferQueue &transfers, BlockCache &cache, BufferPool &buffers,
+                     GroupCommit &commit, bool reuse_port)
+    : mTransfers(transfers),
+      mCache(cache),
+      mBuffers(buffers),
+      mCommit(commit),
+      mRunning(true) {
+  mMainSocketFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  mRootDir = args.mRootDir;
+  mStatistics = args.mStatistics;
+  mIo = IoBackend::create(args.mUring, args.mZeroCopy);
+
+  mRequestBuffers.resize(REQUEST_BATCH * REQUEST_SIZE);
+  mRequestIovs.resize(REQUEST_BATCH);
+  mRequestAddresses.resize(REQUEST_BATCH);
+  mRequestHeaders.resize(REQUEST_BATCH);
+  for (size_t i = 0; i < REQUEST_BATCH; i++) {
+    mRequestIovs[i] = {&mRequestBuffers[i * REQUEST_SIZE], REQUEST_SIZE};
+  }
+
+  if (reuse_port) {
+    int enable = 1;
+    setsockopt(mMainSocketFd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+  }
+
+  mServerAdress = {};
+  memset(&mServerAdress, 0, sizeof(mServerAdress));
+
+  mServerAdress.sin_family = AF_INET;
+  mServerAdress.sin_port = htons(args.mPort);
+
+  bind(mMainSocketFd, reinterpret_cast<sockaddr *>(&mServerAdress), sizeof(mServerAdress));
+
+  mEpollFd = epoll_create1(0);
+  mWakeFd = eventfd(0, EFD_NONBLOCK);
+
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = mMainSocketFd;
+  epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mMainSocketFd, &event);
+
+  event.data.fd = mWakeFd;
+  epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event);
+
+  event.data.fd = mFileIo.getEventFd();
+  epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mFileIo.getEventFd(), &event);
+}
+
+void TFTP::Worker::run(const sigset_t *wait_mask) {
+  std::vector<epoll_event> events(64);
+
+  while (mRunning) {
+    int timeout = mTimers.nextTimeout(std::chrono::steady_clock::now());
+    int ready = epoll_pwait(mEpollFd, events.data(), static_cast<int>(events.size()), timeout, wait_mask);
+
+    if (ready < 0) {
+      if (errno == EINTR) {
+        break;
+      } else {
+        continue;
+      }
+    }
+
+    for (int i = 0; i < ready; i++) {
+      int fd = events[i].data.fd;
+      if (fd == mWakeFd) {
+        handleCommits();
+        continue;
+      }
+      if (fd == mFileIo.getEventFd()) {
+        handleFileIo();
+        continue;
+      }
+
+      // send completions are reported as error on the socket
+      mIo->reapCompletions(fd);
+      if (fd == mMainSocketFd) {
+        acceptRequests();
+        continue;
+      }
+
+      auto connection = mConnections.find(fd);
+      if (connection != mConnections.end()) {
+        connection->second->handleIncoming();
+      }
+    }
+
+    mTimers.advance(std::chrono::steady_clock::now());
+    mIo->flush();
+    // datagrams the kernel could not read, e.g. blocks of a file truncated while it is served
+    for (int fd: mIo->takeFaulted()) {
+      auto connection = mConnections.find(fd);
+      if (connection != mConnections.end()) connection->second->handleSendFault();
+    }
+    reapConnections();
+    watchBlocked();
+  }
+}
+
+void TFTP::Worker::acceptRequests() {
+  while (mRunning) {
+    for (size_t i = 0; i < REQUEST_BATCH; i++) {
+      mRequestHeaders[i] = {};
+      mRequestHeaders[i].msg_hdr.msg_name = &mRequestAddresses[i];
+      mRequestHeaders[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+      mRequestHeaders[i].msg_hdr.msg_iov = &mRequestIovs[i];
+      mRequestHeaders[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int received = recvmmsg(mMainSocketFd, mRequestHeaders.data(), REQUEST_BATCH, MSG_DONTWAIT, nullptr);
+
+    // main socket is drained
+    if (received <= 0) break;
+    mRequestCounters.add(received);
+
+    for (int i = 0; i < received; i++) {
+      if (mRequestHeaders[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        sendError(ErrorPacket{4, "Illegal TFTP operation"}, mRequestAddresses[i]);
+        continue;
+      }
+
+      handleRequest(std::span<const uint8_t>(mRequestBuffers).subspan(i * REQUEST_SIZE, mRequestHeaders[i].msg_len),
+                    mRequestAddresses[i]);
+    }
+
+    // partial batch means there was nothing more to read
+    if (received < static_cast<int>(REQUEST_BATCH)) break;
+  }
+}
+
+void TFTP::Worker::handleRequest(std::span<const uint8_t> buffer, const sockaddr_in &from_address) {
+  PacketView packet;
+  try {
+    packet = parsePacket(buffer);
+  } catch (TFTP::PacketFormatException &e) {
+    sendError(ErrorPacket{4, "Illegal TFTP operation"}, from_address);
+    return;
+  }
+  const auto rrq_packet = std::get_if<RRQView>(&packet);
+  const auto wrq_packet = std::get_if<WRQView>(&packet);
+
+  printPacket(std::cerr, packet, inet_ntoa(from_address.sin_addr), ntohs(from_address.sin_port),
+              ntohs(mServerAdress.sin_port));
+
+  std::filesystem::path path{mRootDir};
+  TransferRequest request{};
+  request.mClientAddr = from_address;
+  try {
+    if (rrq_packet) {
+      path /= rrq_packet->mFilename;
+      request.mMode = Mode::DOWNLOAD;
+      request.mOptions = rrq_packet->getOptions();
+      request.mTransmissionMode = rrq_packet->mMode;
+    } else if (wrq_packet) {
+      path /= wrq_packet->mFilename;
+      request.mMode = Mode::UPLOAD;
+      request.mOptions = wrq_packet->getOptions();
+      request.mTransmissionMode = wrq_packet->mMode;
+    } else {
+      sendError(ErrorPacket{4, "Illegal TFTP operation"}, from_address);
+      return;
+    }
+  } catch (Options::InvalidFormatException &e) {
+    sendError(ErrorPacket{4, "Illegal TFTP operation"}, from_address);
+    return;
+  }
+  request.mFilePath = path;
+
+  // RFC 7440, larger window than we are willing to keep is answered by our maximum
+  if (request.mOptions.isSet(Options::Key::WINDOWSIZE)) {
+    request.mOptions.set(Options::Key::WINDOWSIZE,
+                         std::min(request.mOptions.get(Options::Key::WINDOWSIZE), Options::MAX_WINDOWSIZE));
+  }
+
+  switch (mTransfers.admit(request)) {
+    case TransferQueue::Admission::START:
+      startTransfer(std::move(request));
+      break;
+    case TransferQueue::Admission::QUEUED:
+      break;
+    case TransferQueue::Admission::REJECTED:
+      sendError(ErrorPacket{0, "Server busy"}, from_address);
+      break;
+  }
+}
+
+void TFTP::Worker::startTransfer(TransferRequest request) {
+  std::optional<TransferRequest> next = std::move(request);
+
+  while (next.has_value()) {
+    auto connection = std::make_unique<TFTP::Connection>(next->mFilePath, next->mOptions,
+                                                         next->mClientAddr, next->mTransmissionMode, *mIo, mTimers,
+                                                         mCache, mBuffers, mCommit, mWakeFd, mFileIo);
+    if (next->mMode == Mode::DOWNLOAD) {
+      connection->startDownload();
+    } else {
+      connection->startUpload();
+    }
+
+    if (!connection->isFinished()) {
+      addConnection(std::move(connection));
+      return;
+    }
+
+    // transfer ended right away, its slot goes to next queued request
+    next = mTransfers.release();
+  }
+}
+
+void TFTP::Worker::sendError(const ErrorPacket &error_packet, const sockaddr_in &address) const {
+  mIo->send(mMainSocketFd, error_packet.serialize(), address);
+}
+
+void TFTP::Worker::addConnection(std::unique_ptr<Connection> connection) {
+  int fd = connection->getSocketFd();
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event);
+
+  mConnections[fd] = std::move(connection);
+}
+
+void TFTP::Worker::handleCommits() {
+  uint64_t value;
+  if (read(mWakeFd, &value, sizeof(value)) <= 0) return;
+
+  // single wake can stand for several commits, connections not committing return right away
+  for (auto &[fd, connection]: mConnections) {
+    connection->handleCommitted();
+  }
+}
+
+void TFTP::Worker::handleFileIo() {
+  // connection may be gone already, its socket number is then unused or belongs to a connection not waiting
+  for (int fd: mFileIo.takeReady()) {
+    auto connection = mConnections.find(fd);
+    if (connection != mConnections.end()) connection->second->handleFileReady();
+  }
+}
+
+void TFTP::Worker::reapConnections() {
+  for (auto it = mConnections.begin(); it != mConnections.end();) {
+    if (it->second->isFinished()) {
+      auto &connection = *it->second;
+      if (mStatistics && connection.getMode() == Mode::DOWNLOAD) {
+        // single write, lines of different workers do not interleave
+        std::ostringstream line;
+        line << "TRANSFER " << inet_ntoa(connection.getClientAddress().sin_addr) << ":"
+             << ntohs(connection.getClientAddress().sin_port) << " window " << connection.getCongestionWindow().get()
+             << " loss " << connection.getCongestionWindow().getLossRate() << "\n";
+        std::cerr << line.str();
+      }
+
+      // socket is not closed right away if the kernel still holds buffers sent from it
+      epoll_ctl(mEpollFd, EPOLL_CTL_DEL, it->first, nullptr);
+      std::erase(mBlocked, it->first);
+      it = mConnections.erase(it);
+
+      auto next = mTransfers.release();
+      if (next.has_value()) startTransfer(std::move(*next));
+    } else {
+      it++;
+    }
+  }
+}
+
+void TFTP::Worker::watchBlocked() {
+  auto blocked = mIo->getBlocked();
+  if (blocked.empty() && mBlocked.empty()) return;
+
+  epoll_event event = {};
+  for (int fd: mBlocked) {
+    if (std::find(blocked.begin(), blocked.end(), fd) != blocked.end()) continue;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event);
+  }
+  for (int fd: blocked) {
+    if (std::find(mBlocked.begin(), mBlocked.end(), fd) != mBlocked.end()) continue;
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.fd = fd;
+    epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, &event);
+  }
+  mBlocked = std::move(blocked);
+}
+
+void TFTP::Worker::stop() {
+  mRunning = false;
+  uint64_t value = 1;
+  write(mWakeFd, &value, sizeof(value));
+}
+
+TFTP::Worker::~Worker() {
+  for (auto &[fd, connection]: mConnections) {
+    connection->cleanup();
+  }
+  mConnections.clear();
+  mIo.reset();
+
+  close(mWakeFd);
+  close(mEpollFd);
+  close(mMainSocketFd);
+}
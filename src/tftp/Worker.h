@@ -0,0 +1,158 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_WORKER_H
+#define ISA_PROJECT_WORKER_H
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+#include <map>
+#include <sstream>
+
+#include "../utils/ArgParser.h"
+#include "../utils/BlockCache.h"
+#include "../utils/BufferPool.h"
+#include "../utils/FileIoPool.h"
+#include "../utils/GroupCommit.h"
+#include "../utils/TimerWheel.h"
+#include "Connection.h"
+#include "IoBackend.h"
+#include "Packet.h"
+#include "PacketView.h"
+#include "TransferQueue.h"
+
+namespace TFTP {
+  /**
+   * @brief Worker class, owns one listening socket and multiplexes it with all its connection sockets
+   * in single epoll event loop, retransmissions of all its connections are driven by one timer wheel,
+   * multiple workers can share the server port through SO_REUSEPORT
+   */
+  class Worker {
+    int mMainSocketFd;
+    int mEpollFd;
+    int mWakeFd;
+    sockaddr_in mServerAdress;
+    std::string mRootDir;
+    // whether finished downloads report their congestion window and loss rate
+    bool mStatistics;
+
+    TransferQueue &mTransfers;
+    BlockCache &mCache;
+    BufferPool &mBuffers;
+    GroupCommit &mCommit;
+    std::unique_ptr<IoBackend> mIo;
+
+    static constexpr size_t REQUEST_BATCH = 32;
+    // no valid request can be longer, path alone is limited to 4096 bytes
+    static constexpr size_t REQUEST_SIZE = 8192;
+
+    std::vector<uint8_t> mRequestBuffers;
+    std::vector<iovec> mRequestIovs;
+    std::vector<sockaddr_in> mRequestAddresses;
+    std::vector<mmsghdr> mRequestHeaders;
+    BatchCounters mRequestCounters;
+    std::atomic<bool> mRunning;
+    TimerWheel mTimers;
+    // outlives the connections, tasks of their files may still run when they are destroyed
+    FileIoPool mFileIo;
+    std::map<int, std::unique_ptr<Connection>> mConnections;
+    // sockets waiting for room in their send buffer, polled for EPOLLOUT as well
+    std::vector<int> mBlocked;
+
+    /**
+     * @brief Receives all requests waiting on the main socket, in batches by recvmmsg
+     */
+    void acceptRequests();
+
+    /**
+     * @brief Handles single request received on the main socket, starts new connection if it is valid
+     * @param buffer received datagram, parsed in place
+     * @param from_address address of the client
+     */
+    void handleRequest(std::span<const uint8_t> buffer, const sockaddr_in &from_address);
+
+    /**
+     * @brief Starts transfer for admitted request, if it ends right away, starts next queued request instead
+     * @param request request holding a transfer slot
+     */
+    void startTransfer(TransferRequest request);
+
+    /**
+     * @brief Sends error packet to the client from the main socket
+     * @param error_packet packet to be sent
+     * @param address address of the client
+     */
+    void sendError(const ErrorPacket &error_packet, const sockaddr_in &address) const;
+
+    /**
+     * @brief Registers started connection in the event loop
+     * @param connection started connection
+     */
+    void addConnection(std::unique_ptr<Connection> connection);
+
+    /**
+     * @brief Finishes uploads whose commit is done, called when the committer wakes the worker
+     */
+    void handleCommits();
+
+    /**
+     * @brief Continues connections whose files were read by the file io pool
+     */
+    void handleFileIo();
+
+    /**
+     * @brief Destroys finished connections and hands their slots to queued requests
+     */
+    void reapConnections();
+
+    /**
+     * @brief Polls sockets with held datagrams for EPOLLOUT, so the next flush retries them once they have room,
+     * sockets which sent everything are polled only for input again
+     */
+    void watchBlocked();
+
+  public:
+    /**
+     * @brief Worker constructor
+     * @param args structure holding arguments passed to the program
+     * @param transfers transfer limit shared by all workers
+     * @param cache block cache shared by all workers
+     * @param buffers buffer pool shared by all workers
+     * @param commit committer of uploads shared by all workers
+     * @param reuse_port whether the listening socket should be bound with SO_REUSEPORT
+     */
+    Worker(const ServerArgs &args, TransferQueue &transfers, BlockCache &cache, BufferPool &buffers,
+           GroupCommit &commit, bool reuse_port);
+
+    Worker(const Worker &) = delete;
+    Worker &operator=(const Worker &) = delete;
+
+    ~Worker();
+
+    /**
+     * @brief Runs the event loop until stopped or interrupted by a signal
+     * @param wait_mask signal mask set only while waiting for events, so a signal blocked otherwise cannot be missed
+     * by arriving between the waits, nullptr keeps the mask of the thread
+     */
+    void run(const sigset_t *wait_mask = nullptr);
+
+    /**
+     * @brief Stops the event loop, safe to call from another thread
+     */
+    void stop();
+
+    /**
+     * @return counters of syscalls receiving requests
+     */
+    [[nodiscard]] const BatchCounters &getRequestCounters() const { return mRequestCounters; }
+
+    /**
+     * @return counters of syscalls sending packets
+     */
+    [[nodiscard]] const BatchCounters &getSendCounters() const { return mIo->getSendCounters(); }
+  };
+}// namespace TFTP
+
+
+#endif//ISA_PROJECT_WORKER_H
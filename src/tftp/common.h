@@ -46,10 +46,16 @@ namespace TFTP {
     DATA_TRANSFER,
     SENT_WRQ,
     RECEIVED_WRQ,
+    COMMITTING,
     FINAL_ACK,
     ERROR,
     FINISHED
   };
+
+  /**
+   * @brief Exchange is given up after no progress was made for this many negotiated timeouts
+   */
+  constexpr int MAX_RETRIES = 3;
 }// namespace TFTP
 
 #endif//ISA_PROJECT_COMMON_H
@@ -3,12 +3,12 @@
 #include "ArgParser.h"
 
 void printServerHelp() {
-  std::cout << "Usage: tftp-server [-p PORT] ROOT_DIR" << std::endl;
+  std::cout << "Usage: tftp-server [-p PORT] [-w WORKERS] [-m MAX_TRANSFERS] [-q MAX_QUEUED] [-c CACHE_MB] [-u] [-z] [-s] [-d] ROOT_DIR" << std::endl;
 }
 
 void printClientHelp() {
-  std::cout << "Usage download: tftp-client -h HOST -t DESTINATION_PATH [-p PORT] [-f SOURCE_PATH]" << std::endl;
-  std::cout << "Usage upload (reads from stdin): tftp-client -h HOST -t DESTINATION_PATH [-p PORT]" << std::endl;
+  std::cout << "Usage download: tftp-client -h HOST -t DESTINATION_PATH [-p PORT] [-f SOURCE_PATH] [-w WINDOWSIZE] [-u]" << std::endl;
+  std::cout << "Usage upload (reads from stdin): tftp-client -h HOST -t DESTINATION_PATH [-p PORT] [-w WINDOWSIZE] [-u]" << std::endl;
 }
 
 ClientArgs ArgParser::parseClientArgs(char *argv[], int argc) {
@@ -19,9 +19,11 @@ ClientArgs ArgParser::parseClientArgs(char *argv[], int argc) {
           .mPort = 69,
           .mSrcFilePath = std::nullopt,
           .mDestFilePath = std::string(),
+          .mUring = false,
+          .mWindowSize = 0,
   };
 
-  while ((opt = getopt(argc, argv, "h:p:f:t:")) != -1) {
+  while ((opt = getopt(argc, argv, "h:p:f:t:w:u")) != -1) {
     switch (opt) {
       case 'h':
         args.mAddress = optarg;
@@ -35,6 +37,16 @@ ClientArgs ArgParser::parseClientArgs(char *argv[], int argc) {
       case 't':
         args.mDestFilePath = optarg;
         break;
+      case 'w':
+        args.mWindowSize = std::strtol(optarg, nullptr, 10);
+        if (args.mWindowSize < 1 || args.mWindowSize > 65535) {
+          printClientHelp();
+          exit(2);
+        }
+        break;
+      case 'u':
+        args.mUring = true;
+        break;
       default:
         printClientHelp();
         exit(2);
@@ -63,6 +75,8 @@ std::ostream &operator<<(std::ostream &os, const ClientArgs &obj) {
 
   os << "Src file path: " << path << std::endl;
   os << "Dst file path: " << obj.mDestFilePath << std::endl;
+  os << "io_uring: " << obj.mUring << std::endl;
+  os << "Windowsize: " << obj.mWindowSize << std::endl;
 
   return os;
 }
@@ -72,13 +86,45 @@ ServerArgs ArgParser::parseServerArgs(char *argv[], int argc) {
 
   ServerArgs args{
           .mPort = 69,
-          .mRootDir = std::string()};
-
-  while ((opt = getopt(argc, argv, "p:")) != -1) {
+          .mRootDir = std::string(),
+          .mWorkers = 1,
+          .mMaxTransfers = 0,
+          .mMaxPending = 0,
+          .mUring = false,
+          .mStatistics = false,
+          .mZeroCopy = false,
+          .mCacheSize = 64 << 20,
+          .mDurable = false};
+
+  while ((opt = getopt(argc, argv, "p:w:m:q:c:uszd")) != -1) {
     switch (opt) {
       case 'p':
         args.mPort = std::strtol(optarg, nullptr, 10);
         break;
+      case 'w':
+        args.mWorkers = std::strtol(optarg, nullptr, 10);
+        break;
+      case 'm':
+        args.mMaxTransfers = std::strtol(optarg, nullptr, 10);
+        break;
+      case 'q':
+        args.mMaxPending = std::strtol(optarg, nullptr, 10);
+        break;
+      case 'c':
+        args.mCacheSize = static_cast<size_t>(std::strtoul(optarg, nullptr, 10)) << 20;
+        break;
+      case 'u':
+        args.mUring = true;
+        break;
+      case 's':
+        args.mStatistics = true;
+        break;
+      case 'z':
+        args.mZeroCopy = true;
+        break;
+      case 'd':
+        args.mDurable = true;
+        break;
       default:
         printServerHelp();
         exit(2);
@@ -107,6 +153,14 @@ ServerArgs ArgParser::parseServerArgs(char *argv[], int argc) {
 std::ostream &operator<<(std::ostream &os, const ServerArgs &obj) {
   os << "Port: " << obj.mPort << std::endl;
   os << "Root dir: " << obj.mRootDir << std::endl;
+  os << "Workers: " << obj.mWorkers << std::endl;
+  os << "Max transfers: " << obj.mMaxTransfers << std::endl;
+  os << "Max queued: " << obj.mMaxPending << std::endl;
+  os << "io_uring: " << obj.mUring << std::endl;
+  os << "Statistics: " << obj.mStatistics << std::endl;
+  os << "Zero-copy: " << obj.mZeroCopy << std::endl;
+  os << "Cache size: " << obj.mCacheSize << std::endl;
+  os << "Durable: " << obj.mDurable << std::endl;
 
   return os;
 }
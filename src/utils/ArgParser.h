@@ -20,6 +20,12 @@ struct ClientArgs {
   std::optional<std::string> mSrcFilePath;
   std::string mDestFilePath;
 
+  // whether io_uring should be used for socket io
+  bool mUring;
+
+  // windowsize requested from the server, 0 if it is not requested
+  long mWindowSize;
+
 public:
   friend std::ostream &operator<<(std::ostream &os, const ClientArgs &obj);
 };
@@ -30,6 +36,22 @@ public:
 struct ServerArgs {
   uint32_t mPort;
   std::string mRootDir;
+  // number of workers, 0 means one per core
+  uint32_t mWorkers;
+  // maximum number of concurrent transfers, 0 means unlimited
+  uint32_t mMaxTransfers;
+  // maximum number of requests waiting for free transfer slot
+  uint32_t mMaxPending;
+  // whether io_uring should be used for socket io
+  bool mUring;
+  // whether syscall batching statistics are printed on exit
+  bool mStatistics;
+  // whether datagrams are sent with MSG_ZEROCOPY
+  bool mZeroCopy;
+  // size of the block cache shared by all workers in bytes, 0 disables it
+  size_t mCacheSize;
+  // whether uploads are synced to disk before the final ACK
+  bool mDurable;
 
 public:
   friend std::ostream &operator<<(std::ostream &os, const ServerArgs &obj);
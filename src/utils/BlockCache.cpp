@@ -0,0 +1,129 @@
+// Matej Sirovatka, xsirov00
+
+#include "BlockCache.h"
+
+#include <functional>
+#include <memory>
+
+size_t BlockCache::KeyHash::operator()(const Key &key) const {
+  size_t hash = std::hash<std::string>()(key.mPath);
+  for (uint64_t value: {key.mDevice, key.mInode, static_cast<uint64_t>(key.mModified), key.mSize,
+                        static_cast<uint64_t>(key.mBlockSize), key.mBlock}) {
+    hash ^= std::hash<uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  }
+  return hash;
+}
+
+BlockCache::BlockCache(size_t capacity) : mShardCapacity(capacity / SHARDS),
+                                          mSeenCapacity(mShardCapacity / SEEN_BLOCK_SIZE),
+                                          mHits(0),
+                                          mMisses(0) {}
+
+BlockCache::Shard &BlockCache::shard(const Key &key) {
+  // consecutive blocks of one file are spread over all shards
+  return mShards[(std::hash<std::string>()(key.mPath) + key.mBlock) % SHARDS];
+}
+
+BlockCache::Shard &BlockCache::shard(const std::string &path) {
+  return mShards[std::hash<std::string>()(path) % SHARDS];
+}
+
+SharedBytes BlockCache::get(const Key &key) {
+  if (!enabled()) return {};
+
+  Shard &shard = this->shard(key);
+  std::lock_guard<std::mutex> lock(shard.mMutex);
+
+  auto it = shard.mIndex.find(key);
+  if (it == shard.mIndex.end()) {
+    mMisses.fetch_add(1, std::memory_order_relaxed);
+    return {};
+  }
+
+  mHits.fetch_add(1, std::memory_order_relaxed);
+  shard.mEntries.splice(shard.mEntries.begin(), shard.mEntries, it->second);
+  return it->second->second;
+}
+
+bool BlockCache::admit(const Key &key) {
+  if (!enabled()) return false;
+
+  // colliding hash only admits some block early
+  size_t hash = KeyHash()(key);
+  Shard &shard = this->shard(key);
+  std::lock_guard<std::mutex> lock(shard.mMutex);
+
+  // admitted block stays in the history, so it is admitted right away when it is evicted and missed again
+  if (shard.mSeen.contains(hash)) return true;
+
+  if (!shard.mSeenOrder.empty() && shard.mSeenOrder.size() >= mSeenCapacity) {
+    shard.mSeen.erase(shard.mSeenOrder.front());
+    shard.mSeenOrder.pop_front();
+  }
+  if (mSeenCapacity > 0) {
+    shard.mSeenOrder.push_back(hash);
+    shard.mSeen.insert(hash);
+  }
+  return false;
+}
+
+SharedBytes BlockCache::put(const Key &key, std::vector<uint8_t> bytes) {
+  // key is accounted too, so a flood of tiny blocks cannot grow the cache unbounded
+  size_t cost = bytes.size() + key.mPath.size();
+  if (cost > mShardCapacity || bytes.empty()) return {};
+
+  auto owner = std::make_shared<std::vector<uint8_t>>(std::move(bytes));
+  SharedBytes cached{owner, owner->data(), owner->size()};
+
+  Shard &shard = this->shard(key);
+  std::lock_guard<std::mutex> lock(shard.mMutex);
+
+  // another connection might have cached the block meanwhile
+  auto it = shard.mIndex.find(key);
+  if (it != shard.mIndex.end()) {
+    shard.mEntries.splice(shard.mEntries.begin(), shard.mEntries, it->second);
+    return it->second->second;
+  }
+
+  while (!shard.mEntries.empty() && shard.mSize + cost > mShardCapacity) {
+    auto &[evicted_key, evicted] = shard.mEntries.back();
+    shard.mSize -= evicted.mSize + evicted_key.mPath.size();
+    shard.mIndex.erase(evicted_key);
+    shard.mEntries.pop_back();
+  }
+
+  shard.mEntries.emplace_front(key, cached);
+  shard.mIndex.emplace(key, shard.mEntries.begin());
+  shard.mSize += cost;
+  return cached;
+}
+
+std::optional<BlockCache::FileInfo> BlockCache::getFile(const std::string &path) {
+  if (!enabled()) return std::nullopt;
+
+  Shard &shard = this->shard(path);
+  std::lock_guard<std::mutex> lock(shard.mMutex);
+
+  auto it = shard.mFiles.find(path);
+  if (it == shard.mFiles.end()) return std::nullopt;
+  if (std::chrono::steady_clock::now() - it->second.second >= FILE_INFO_TTL) {
+    shard.mFiles.erase(it);
+    return std::nullopt;
+  }
+  return it->second.first;
+}
+
+void BlockCache::putFile(const std::string &path, const FileInfo &info) {
+  if (!enabled()) return;
+
+  auto now = std::chrono::steady_clock::now();
+  Shard &shard = this->shard(path);
+  std::lock_guard<std::mutex> lock(shard.mMutex);
+
+  if (shard.mFiles.size() >= MAX_FILES) {
+    std::erase_if(shard.mFiles, [&](const auto &entry) { return now - entry.second.second >= FILE_INFO_TTL; });
+    // burst of distinct files within the lifetime of an entry starts over
+    if (shard.mFiles.size() >= MAX_FILES) shard.mFiles.clear();
+  }
+  shard.mFiles.insert_or_assign(path, std::make_pair(info, now));
+}
@@ -0,0 +1,174 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_BLOCKCACHE_H
+#define ISA_PROJECT_BLOCKCACHE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "SharedBytes.h"
+
+/**
+ * @brief Size-bounded LRU cache of file blocks shared by all workers, split into shards with their own lock,
+ * so concurrent lookups of different blocks rarely contend, blocks stay alive while packets still use them,
+ * the server stores each block already serialized as DATA packet ready to be sent,
+ * block is admitted only on its second miss, so a single pass over a file larger than the cache does not evict it
+ */
+class BlockCache {
+public:
+  /**
+   * @brief Identifies single block of single version of a file
+   */
+  struct Key {
+    std::string mPath;
+    // file the path pointed to, file replaced under the same path is never matched again
+    uint64_t mDevice;
+    uint64_t mInode;
+    // modification time of the file in nanoseconds and its size, blocks of modified file are never matched again
+    int64_t mModified;
+    uint64_t mSize;
+    uint32_t mBlockSize;
+    // index of the block from the start of the file, does not wrap like block numbers
+    uint64_t mBlock;
+
+    bool operator==(const Key &other) const {
+      return mBlock == other.mBlock && mBlockSize == other.mBlockSize && mModified == other.mModified &&
+             mSize == other.mSize && mInode == other.mInode && mDevice == other.mDevice && mPath == other.mPath;
+    }
+  };
+
+  /**
+   * @brief Attributes of a regular file, cached so transfers of hot files make no filesystem calls
+   */
+  struct FileInfo {
+    uint64_t mDevice;
+    uint64_t mInode;
+    int64_t mModified;
+    uint64_t mSize;
+  };
+
+private:
+  /**
+   * @brief Hash of the key
+   */
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+
+  /**
+   * @brief Independently locked part of the cache, holds its entries from the most recently used
+   */
+  struct Shard {
+    std::mutex mMutex;
+    std::list<std::pair<Key, SharedBytes>> mEntries;
+    std::unordered_map<Key, std::list<std::pair<Key, SharedBytes>>::iterator, KeyHash> mIndex;
+    size_t mSize = 0;
+    // hashes of the blocks missed once, from the oldest
+    std::deque<size_t> mSeenOrder;
+    std::unordered_set<size_t> mSeen;
+    // attributes of the files by path with the time they were taken
+    std::unordered_map<std::string, std::pair<FileInfo, std::chrono::steady_clock::time_point>> mFiles;
+  };
+
+  static constexpr size_t SHARDS = 16;
+  // history of missed blocks covers as many blocks of the default size as the shard holds
+  static constexpr size_t SEEN_BLOCK_SIZE = 512;
+  // cached attributes are trusted this long, like attribute cache of NFS,
+  // file changed meanwhile is still caught by the checks of its mapping
+  static constexpr std::chrono::seconds FILE_INFO_TTL{1};
+  static constexpr size_t MAX_FILES = 1024;
+
+  size_t mShardCapacity;
+  size_t mSeenCapacity;
+  std::array<Shard, SHARDS> mShards;
+
+  std::atomic<uint64_t> mHits;
+  std::atomic<uint64_t> mMisses;
+
+  /**
+   * @param key key of the block
+   * @return shard holding the block
+   */
+  Shard &shard(const Key &key);
+
+  /**
+   * @param path path of the file
+   * @return shard holding attributes of the file
+   */
+  Shard &shard(const std::string &path);
+
+public:
+  /**
+   * @brief BlockCache constructor
+   * @param capacity maximum number of cached bytes, 0 disables the cache
+   */
+  explicit BlockCache(size_t capacity);
+
+  BlockCache(const BlockCache &) = delete;
+  BlockCache &operator=(const BlockCache &) = delete;
+
+  /**
+   * @return true if blocks can be cached
+   */
+  [[nodiscard]] bool enabled() const { return mShardCapacity > 0; }
+
+  /**
+   * @brief Looks up the block and marks it as the most recently used
+   * @param key key of the block
+   * @return cached block, empty if it is not cached
+   */
+  SharedBytes get(const Key &key);
+
+  /**
+   * @brief Decides whether missed block is worth copying into the cache, block missed for the first time
+   * is only remembered, so blocks read once are served without the copy
+   * @param key key of the missed block
+   * @return true if the block was missed recently already
+   */
+  bool admit(const Key &key);
+
+  /**
+   * @brief Stores the block in the cache, evicts least recently used blocks of the shard to make room
+   * @param key key of the block
+   * @param bytes contents stored for the block
+   * @return cached contents, the block cached meanwhile by someone else takes precedence,
+   * empty if the block is not cached
+   */
+  SharedBytes put(const Key &key, std::vector<uint8_t> bytes);
+
+  /**
+   * @param path path of the file
+   * @return attributes of the file taken recently, empty if there are none or the cache is disabled
+   */
+  std::optional<FileInfo> getFile(const std::string &path);
+
+  /**
+   * @brief Stores attributes of the file just taken
+   * @param path path of the file
+   * @param info attributes of the file
+   */
+  void putFile(const std::string &path, const FileInfo &info);
+
+  /**
+   * @return number of lookups that found the block
+   */
+  [[nodiscard]] uint64_t getHits() const { return mHits.load(std::memory_order_relaxed); }
+
+  /**
+   * @return number of lookups that did not find the block
+   */
+  [[nodiscard]] uint64_t getMisses() const { return mMisses.load(std::memory_order_relaxed); }
+};
+
+#endif//ISA_PROJECT_BLOCKCACHE_H
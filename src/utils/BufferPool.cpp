@@ -0,0 +1,72 @@
+// Matej Sirovatka, xsirov00
+
+#include "BufferPool.h"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+BufferPool::Buffer::Buffer(Buffer &&other) noexcept : mPool(std::exchange(other.mPool, nullptr)),
+                                                     mData(std::move(other.mData)),
+                                                     mSize(std::exchange(other.mSize, 0)),
+                                                     mCapacity(std::exchange(other.mCapacity, 0)) {}
+
+BufferPool::Buffer &BufferPool::Buffer::operator=(Buffer &&other) noexcept {
+  if (this != &other) {
+    reset();
+    mPool = std::exchange(other.mPool, nullptr);
+    mData = std::move(other.mData);
+    mSize = std::exchange(other.mSize, 0);
+    mCapacity = std::exchange(other.mCapacity, 0);
+  }
+  return *this;
+}
+
+void BufferPool::Buffer::reset() {
+  if (mPool && mData) mPool->release(std::move(mData), mCapacity);
+  mPool = nullptr;
+  mData.reset();
+  mSize = 0;
+  mCapacity = 0;
+}
+
+BufferPool::BufferPool(size_t max_idle) : mMaxIdle(max_idle), mIdle(0) {}
+
+size_t BufferPool::sizeClass(size_t size) {
+  if (size <= (size_t{1} << MIN_CLASS_SHIFT)) return 0;
+  return std::min(static_cast<size_t>(std::bit_width(size - 1)) - MIN_CLASS_SHIFT, CLASSES);
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t size) {
+  Buffer buffer;
+  buffer.mSize = size;
+
+  size_t index = sizeClass(size);
+  if (index == CLASSES) {
+    // oversized buffer is not worth keeping
+    buffer.mData = std::make_unique_for_overwrite<uint8_t[]>(size);
+    return buffer;
+  }
+
+  buffer.mPool = this;
+  buffer.mCapacity = size_t{1} << (index + MIN_CLASS_SHIFT);
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mFree[index].empty()) {
+      buffer.mData = std::move(mFree[index].back());
+      mFree[index].pop_back();
+      mIdle -= buffer.mCapacity;
+    }
+  }
+
+  if (!buffer.mData) buffer.mData = std::make_unique_for_overwrite<uint8_t[]>(buffer.mCapacity);
+  return buffer;
+}
+
+void BufferPool::release(std::unique_ptr<uint8_t[]> data, size_t capacity) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mIdle + capacity > mMaxIdle) return;
+
+  mFree[sizeClass(capacity)].push_back(std::move(data));
+  mIdle += capacity;
+}
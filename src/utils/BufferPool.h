@@ -0,0 +1,95 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_BUFFERPOOL_H
+#define ISA_PROJECT_BUFFERPOOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+/**
+ * @brief Pool of buffers shared by all workers, buffers are rounded up to power of two size classes,
+ * buffers given back by finished transfers are handed to new ones, memory held by idle buffers is bounded
+ */
+class BufferPool {
+public:
+  /**
+   * @brief Buffer borrowed from the pool, given back when it is destroyed
+   */
+  class Buffer {
+    BufferPool *mPool = nullptr;
+    std::unique_ptr<uint8_t[]> mData;
+    size_t mSize = 0;
+    size_t mCapacity = 0;
+
+    friend class BufferPool;
+
+  public:
+    Buffer() = default;
+
+    Buffer(Buffer &&other) noexcept;
+    Buffer &operator=(Buffer &&other) noexcept;
+
+    ~Buffer() { reset(); }
+
+    /**
+     * @brief Gives the buffer back to the pool
+     */
+    void reset();
+
+    [[nodiscard]] uint8_t *data() const { return mData.get(); }
+
+    /**
+     * @return requested size of the buffer
+     */
+    [[nodiscard]] size_t size() const { return mSize; }
+
+    [[nodiscard]] std::span<uint8_t> span() const { return {mData.get(), mSize}; }
+  };
+
+private:
+  static constexpr size_t MIN_CLASS_SHIFT = 9;
+  static constexpr size_t CLASSES = 16;
+
+  size_t mMaxIdle;
+
+  std::mutex mMutex;
+  std::array<std::vector<std::unique_ptr<uint8_t[]>>, CLASSES> mFree;
+  size_t mIdle;
+
+  /**
+   * @param size requested size
+   * @return index of the smallest size class holding the size, CLASSES if it is too big to be pooled
+   */
+  static size_t sizeClass(size_t size);
+
+  /**
+   * @brief Keeps returned buffer for reuse, frees it if the pool is full
+   * @param data buffer
+   * @param capacity size class of the buffer
+   */
+  void release(std::unique_ptr<uint8_t[]> data, size_t capacity);
+
+public:
+  /**
+   * @brief BufferPool constructor
+   * @param max_idle maximum number of bytes held by buffers waiting for reuse
+   */
+  explicit BufferPool(size_t max_idle);
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  /**
+   * @brief Borrows buffer, allocates new one only if there is no idle buffer of the size class
+   * @param size required size, the contents are undefined
+   * @return buffer of at least given size
+   */
+  Buffer acquire(size_t size);
+};
+
+#endif//ISA_PROJECT_BUFFERPOOL_H
@@ -0,0 +1,86 @@
+// Matej Sirovatka, xsirov00
+
+#include "ByteSearch.h"
+
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BYTE_SEARCH_X86
+#endif
+
+namespace {
+  /**
+   * @brief Scalar search of the rest of the data
+   * @param data data to search
+   * @param start index to start at
+   * @param size size of the data
+   * @param first byte to find
+   * @param second other byte to find
+   * @return index of the first occurrence, size if there is none
+   */
+  size_t findScalar(const char *data, size_t start, size_t size, char first, char second) {
+    for (size_t i = start; i < size; i++) {
+      if (data[i] == first || data[i] == second) return i;
+    }
+    return size;
+  }
+
+#ifdef BYTE_SEARCH_X86
+#ifdef __SSE2__
+  size_t findSse2(const char *data, size_t size, char first, char second) {
+    const __m128i first_mask = _mm_set1_epi8(first);
+    const __m128i second_mask = _mm_set1_epi8(second);
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      __m128i matches = _mm_or_si128(_mm_cmpeq_epi8(chunk, first_mask), _mm_cmpeq_epi8(chunk, second_mask));
+      auto mask = static_cast<uint32_t>(_mm_movemask_epi8(matches));
+      if (mask) return i + std::countr_zero(mask);
+    }
+    return findScalar(data, i, size, first, second);
+  }
+#endif
+
+  // compiled for AVX2 regardless of build flags, only called after the cpu is checked
+  __attribute__((target("avx2"))) size_t findAvx2(const char *data, size_t size, char first, char second) {
+    const __m256i first_mask = _mm256_set1_epi8(first);
+    const __m256i second_mask = _mm256_set1_epi8(second);
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+      __m256i matches = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, first_mask), _mm256_cmpeq_epi8(chunk, second_mask));
+      auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+      if (mask) return i + std::countr_zero(mask);
+    }
+    return findScalar(data, i, size, first, second);
+  }
+#endif
+
+  using find_t = size_t (*)(const char *, size_t, char, char);
+
+  /**
+   * @return fastest implementation supported by the cpu
+   */
+  find_t selectImplementation() {
+#ifdef BYTE_SEARCH_X86
+    if (__builtin_cpu_supports("avx2")) return findAvx2;
+#ifdef __SSE2__
+    return findSse2;
+#endif
+#endif
+    return [](const char *data, size_t size, char first, char second) {
+      return findScalar(data, 0, size, first, second);
+    };
+  }
+}// namespace
+
+namespace ByteSearch {
+  size_t findEither(const char *data, size_t size, char first, char second) {
+    static const find_t find = selectImplementation();
+    return find(data, size, first, second);
+  }
+}// namespace ByteSearch
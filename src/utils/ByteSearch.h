@@ -0,0 +1,24 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_BYTESEARCH_H
+#define ISA_PROJECT_BYTESEARCH_H
+
+#include <cstddef>
+
+/**
+ * @brief Searching of bytes that need netascii translation, on x86 runs compare 32 bytes at once with AVX2
+ * if the cpu supports it, 16 bytes with SSE2 otherwise, other platforms use scalar loop
+ */
+namespace ByteSearch {
+  /**
+   * @brief Finds first occurrence of either of two bytes
+   * @param data data to search
+   * @param size size of the data
+   * @param first byte to find
+   * @param second other byte to find, can be the same as first
+   * @return index of the first occurrence, size if there is none
+   */
+  size_t findEither(const char *data, size_t size, char first, char second);
+}// namespace ByteSearch
+
+#endif//ISA_PROJECT_BYTESEARCH_H
@@ -0,0 +1,33 @@
+// Matej Sirovatka, xsirov00
+
+#include "CongestionWindow.h"
+
+#include <algorithm>
+
+CongestionWindow::CongestionWindow(long max) : mMax(std::max(max, 1l)) {
+  mWindow = std::min(INITIAL_WINDOW, static_cast<double>(mMax));
+  mThreshold = mMax;
+}
+
+void CongestionWindow::acknowledged(long blocks) {
+  for (long i = 0; i < blocks; i++) {
+    mWindow += mWindow < mThreshold ? 1 : 1 / mWindow;
+  }
+  mWindow = std::min(mWindow, static_cast<double>(mMax));
+}
+
+void CongestionWindow::lost(long blocks) {
+  mLost += blocks;
+  mThreshold = std::max(mWindow / 2, 1.0);
+  mWindow = mThreshold;
+}
+
+void CongestionWindow::timedOut(long blocks) {
+  mLost += blocks;
+  mThreshold = std::max(mWindow / 2, 1.0);
+  mWindow = 1;
+}
+
+long CongestionWindow::get() const {
+  return std::clamp(static_cast<long>(mWindow), 1l, mMax);
+}
@@ -0,0 +1,78 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_CONGESTIONWINDOW_H
+#define ISA_PROJECT_CONGESTIONWINDOW_H
+
+#include <cstdint>
+
+/**
+ * @brief Number of blocks a sender may have in flight, grows by slow start and additive increase,
+ * shrinks multiplicatively on loss, bounded by the negotiated windowsize
+ */
+class CongestionWindow {
+public:
+  static constexpr double INITIAL_WINDOW = 4;
+
+private:
+  double mWindow;
+  double mThreshold;
+  long mMax;
+
+  // blocks sent for the first time, sent again, and reported lost by the receiver or the timeout
+  uint64_t mSent = 0;
+  uint64_t mRetransmitted = 0;
+  uint64_t mLost = 0;
+
+public:
+  /**
+   * @brief CongestionWindow constructor
+   * @param max upper bound of the window
+   */
+  explicit CongestionWindow(long max);
+
+  /**
+   * @brief Grows the window, by one block per acknowledged block in slow start,
+   * by one block per window afterwards
+   * @param blocks number of newly acknowledged blocks
+   */
+  void acknowledged(long blocks);
+
+  /**
+   * @brief Halves the window after blocks were lost while acknowledgements still arrive
+   * @param blocks number of blocks that have to be retransmitted
+   */
+  void lost(long blocks);
+
+  /**
+   * @brief Collapses the window to single block after retransmission timeout
+   * @param blocks number of blocks that have to be retransmitted
+   */
+  void timedOut(long blocks);
+
+  /**
+   * @brief Records blocks sent for the first time for loss rate
+   * @param blocks number of sent blocks
+   */
+  void sent(long blocks) { mSent += blocks; }
+
+  /**
+   * @brief Records blocks sent again for loss rate
+   * @param blocks number of resent blocks
+   */
+  void resent(long blocks) { mRetransmitted += blocks; }
+
+  /**
+   * @return number of blocks that may be in flight
+   */
+  [[nodiscard]] long get() const;
+
+  /**
+   * @return ratio of lost blocks to all transmissions, retransmissions included
+   */
+  [[nodiscard]] double getLossRate() const {
+    uint64_t transmissions = mSent + mRetransmitted;
+    return transmissions ? static_cast<double>(mLost) / transmissions : 0;
+  }
+};
+
+#endif//ISA_PROJECT_CONGESTIONWINDOW_H
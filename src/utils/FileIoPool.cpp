@@ -0,0 +1,76 @@
+// Matej Sirovatka, xsirov00
+
+#include "FileIoPool.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstdint>
+
+#include "utils.h"
+
+FileIoPool::FileIoPool(size_t threads) {
+  mEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  for (size_t i = 0; i < threads; i++) {
+    mThreads.push_back(startBackgroundThread(&FileIoPool::run, this));
+  }
+}
+
+FileIoPool::~FileIoPool() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+    mTasks.clear();
+  }
+  mCondition.notify_all();
+  for (auto &thread: mThreads) thread.join();
+  close(mEventFd);
+}
+
+void FileIoPool::run() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mCondition.wait(lock, [this] { return mStop || !mTasks.empty(); });
+    if (mStop) return;
+
+    auto task = std::move(mTasks.front());
+    mTasks.pop_front();
+    lock.unlock();
+    task();
+    // whatever the task captured is released before the lock is taken again
+    task = nullptr;
+    lock.lock();
+  }
+}
+
+void FileIoPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mTasks.push_back(std::move(task));
+  }
+  mCondition.notify_one();
+}
+
+void FileIoPool::notify(int key) {
+  bool wake;
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    // eventfd is written once until the worker takes the keys
+    wake = mReady.empty();
+    mReady.push_back(key);
+  }
+  if (wake) {
+    uint64_t value = 1;
+    write(mEventFd, &value, sizeof(value));
+  }
+}
+
+std::vector<int> FileIoPool::takeReady() {
+  uint64_t value;
+  read(mEventFd, &value, sizeof(value));
+
+  std::vector<int> ready;
+  std::lock_guard<std::mutex> lock(mMutex);
+  ready.swap(mReady);
+  return ready;
+}
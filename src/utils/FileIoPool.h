@@ -0,0 +1,79 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_FILEIOPOOL_H
+#define ISA_PROJECT_FILEIOPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Bounded pool of threads doing blocking file io for connections of one worker, so the event loop
+ * never waits for the disk, work done for a connection is reported by its key through an eventfd
+ * polled by the worker, any number of transfers share the same few threads
+ */
+class FileIoPool {
+public:
+  static constexpr size_t THREADS = 4;
+
+private:
+  int mEventFd;
+
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::deque<std::function<void()>> mTasks;
+  // keys of the connections notified since the worker last took them
+  std::vector<int> mReady;
+  bool mStop = false;
+
+  std::vector<std::thread> mThreads;
+
+  /**
+   * @brief Body of the pool threads, runs queued tasks until stopped
+   */
+  void run();
+
+public:
+  /**
+   * @brief FileIoPool constructor, starts the threads
+   * @param threads number of threads
+   */
+  explicit FileIoPool(size_t threads = THREADS);
+
+  FileIoPool(const FileIoPool &) = delete;
+  FileIoPool &operator=(const FileIoPool &) = delete;
+
+  /**
+   * @brief Stops the threads once their running tasks are done, tasks not started yet are dropped
+   */
+  ~FileIoPool();
+
+  /**
+   * @return eventfd readable once some connection was notified
+   */
+  [[nodiscard]] int getEventFd() const { return mEventFd; }
+
+  /**
+   * @brief Queues task to be run by one of the threads, tasks keep what they use alive by themselves
+   * @param task task to be run
+   */
+  void submit(std::function<void()> task);
+
+  /**
+   * @brief Reports that work of a connection is done, safe to call from any thread
+   * @param key key of the connection
+   */
+  void notify(int key);
+
+  /**
+   * @brief Consumes the eventfd and takes the keys notified since the last call, called by the worker
+   * @return keys of the connections, a key may repeat
+   */
+  std::vector<int> takeReady();
+};
+
+#endif//ISA_PROJECT_FILEIOPOOL_H
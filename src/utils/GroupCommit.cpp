@@ -0,0 +1,146 @@
+// Matej Sirovatka, xsirov00
+
+#include "GroupCommit.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <utility>
+
+#include "utils.h"
+
+GroupCommit::GroupCommit(bool enabled) : mEnabled(enabled), mCommits(0), mSyncs(0) {
+  if (mEnabled) mThread = startBackgroundThread(&GroupCommit::run, this);
+}
+
+GroupCommit::~GroupCommit() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStop = true;
+  }
+  mPendingCondition.notify_one();
+  if (mThread.joinable()) mThread.join();
+}
+
+std::shared_ptr<GroupCommit::Ticket> GroupCommit::submit(std::filesystem::path staging, std::filesystem::path target,
+                                                         int wake_fd, int fd) {
+  auto ticket = std::make_shared<Ticket>();
+  ticket->mStaging = std::move(staging);
+  ticket->mTarget = std::move(target);
+  ticket->mWakeFd = wake_fd;
+  ticket->mFd = fd;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending.push_back(ticket);
+  }
+  mPendingCondition.notify_one();
+  return ticket;
+}
+
+std::optional<int> GroupCommit::result(const Ticket &ticket) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (!ticket.mDone) return std::nullopt;
+  return ticket.mError;
+}
+
+int GroupCommit::wait(const Ticket &ticket) const {
+  std::unique_lock<std::mutex> lock(mMutex);
+  mDoneCondition.wait(lock, [&ticket] { return ticket.mDone; });
+  return ticket.mError;
+}
+
+void GroupCommit::run() {
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mPendingCondition.wait(lock, [this] { return mStop || !mPending.empty(); });
+    // pending uploads are committed before the thread stops
+    if (mPending.empty()) return;
+
+    // uploads completing right after the first one share its syncs
+    mPendingCondition.wait_for(lock, GROUP_DELAY, [this] { return mStop; });
+    auto batch = std::move(mPending);
+    mPending.clear();
+
+    lock.unlock();
+    commit(batch);
+    lock.lock();
+
+    // eventfd is written under the lock, so the upload waiting for its ticket cannot close it meanwhile
+    for (auto &ticket: batch) {
+      ticket->mDone = true;
+      uint64_t value = 1;
+      write(ticket->mWakeFd, &value, sizeof(value));
+    }
+    mCommits += batch.size();
+    mDoneCondition.notify_all();
+  }
+}
+
+int GroupCommit::sync(int fd, bool directory) {
+  mSyncs++;
+  int result = directory ? fsync(fd) : fdatasync(fd);
+  return result == 0 ? 0 : errno;
+}
+
+void GroupCommit::commit(const std::vector<std::shared_ptr<Ticket>> &batch) {
+  // descriptors stay open until their data are synced
+  std::vector<std::pair<int, Ticket *>> files;
+  for (auto &ticket: batch) {
+    int fd = std::exchange(ticket->mFd, -1);
+    if (fd < 0) fd = open(ticket->mStaging.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      ticket->mError = errno;
+      continue;
+    }
+    files.emplace_back(fd, ticket.get());
+
+    // writeback of every file is started before waiting for any of them, so the disk writes them together,
+    // it is only a hint, write errors are reported by the sync of the file below
+    if (mStartWriteback && sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE) != 0 &&
+        (errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP || errno == ESPIPE)) {
+      LOG("sync_file_range is not supported, files of a batch are synced one by one")
+      mStartWriteback = false;
+    }
+  }
+
+  // waits mostly for writes already in flight, metadata of the files share the journal commits
+  for (auto &[fd, ticket]: files) {
+    ticket->mError = sync(fd, false);
+    close(fd);
+  }
+
+  // file is published only once its data are on disk, so crash never leaves partial file under its name
+  std::map<std::filesystem::path, std::vector<Ticket *>> directories;
+  for (auto &ticket: batch) {
+    if (ticket->mError == 0) ticket->mError = publish(ticket->mStaging, ticket->mTarget);
+    if (ticket->mError != 0) continue;
+
+    auto directory = ticket->mTarget.parent_path();
+    directories[directory.empty() ? "." : directory].push_back(ticket.get());
+  }
+
+  for (auto &[directory, tickets]: directories) {
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int error = fd < 0 ? errno : sync(fd, true);
+    if (fd >= 0) close(fd);
+    if (error == 0) continue;
+
+    // rename that may not survive a crash is not reported as committed, the published file is left in place,
+    // its data are synced and removing it could destroy a file the client already relies on
+    for (auto ticket: tickets) ticket->mError = error;
+  }
+}
+
+int GroupCommit::publish(const std::filesystem::path &staging, const std::filesystem::path &target) {
+  if (renameat2(AT_FDCWD, staging.c_str(), AT_FDCWD, target.c_str(), RENAME_NOREPLACE) == 0) return 0;
+  if (errno != EINVAL && errno != ENOSYS) return errno;
+
+  // filesystem does not support RENAME_NOREPLACE, link fails the same way if the target exists
+  if (link(staging.c_str(), target.c_str()) != 0) return errno;
+  unlink(staging.c_str());
+  return 0;
+}
@@ -0,0 +1,146 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_GROUPCOMMIT_H
+#define ISA_PROJECT_GROUPCOMMIT_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Commits completed uploads durably on its own thread, shared by all workers, uploads completing
+ * close together are committed as one batch, writeback of all files of the batch is started at once
+ * and each of them is then synced on its own, so their writes overlap and only the files of the batch are synced,
+ * then the files are renamed to their names and each of their directories is synced once per batch
+ */
+class GroupCommit {
+public:
+  /**
+   * @brief Single upload waiting for its commit, shared by the upload and the commit thread
+   */
+  struct Ticket {
+    // fully written file under its temporary name
+    std::filesystem::path mStaging;
+    // name the file is published under
+    std::filesystem::path mTarget;
+    // eventfd written once the commit is done
+    int mWakeFd;
+    // descriptor of the staging file owned by the committer, -1 if the file has to be opened by name
+    int mFd;
+    // set under the lock of the committer, mError is valid once it is set
+    bool mDone = false;
+    // errno of the failed step, 0 if the file was committed, file is published even if only its directory
+    // failed to sync, otherwise it stays under its temporary name
+    int mError = 0;
+  };
+
+private:
+  // time the first upload of a batch waits for others to join it
+  static constexpr std::chrono::milliseconds GROUP_DELAY{10};
+
+  bool mEnabled;
+  // cleared once sync_file_range turns out not to be supported, files are then only synced one by one
+  bool mStartWriteback = true;
+
+  mutable std::mutex mMutex;
+  std::condition_variable mPendingCondition;
+  mutable std::condition_variable mDoneCondition;
+  std::vector<std::shared_ptr<Ticket>> mPending;
+  bool mStop = false;
+
+  std::atomic<uint64_t> mCommits;
+  std::atomic<uint64_t> mSyncs;
+
+  std::thread mThread;
+
+  /**
+   * @brief Body of the commit thread, takes pending uploads in batches until stopped
+   */
+  void run();
+
+  /**
+   * @brief Syncs data of all files in batch, publishes them and syncs their directories
+   * @param batch uploads to be committed, their errors are set
+   */
+  void commit(const std::vector<std::shared_ptr<Ticket>> &batch);
+
+  /**
+   * @brief Syncs data of a file, or a directory with its entries
+   * @param fd descriptor of the file or directory
+   * @param directory whether fd is a directory
+   * @return 0 on success, errno otherwise
+   */
+  int sync(int fd, bool directory);
+
+public:
+  /**
+   * @brief GroupCommit constructor, starts the commit thread only if enabled
+   * @param enabled whether uploads should be synced to disk before they are acknowledged
+   */
+  explicit GroupCommit(bool enabled);
+
+  GroupCommit(const GroupCommit &) = delete;
+  GroupCommit &operator=(const GroupCommit &) = delete;
+
+  /**
+   * @brief commits uploads still pending and stops the thread
+   */
+  ~GroupCommit();
+
+  /**
+   * @return true if uploads are committed by this object, otherwise they are just published
+   */
+  [[nodiscard]] bool isEnabled() const { return mEnabled; }
+
+  /**
+   * @brief Queues upload to be committed with the next batch
+   * @param staging fully written file under its temporary name
+   * @param target name the file should be published under
+   * @param wake_fd eventfd written once the commit is done
+   * @param fd descriptor of the staging file the upload was written by, closed by the committer,
+   * -1 if the file has to be opened by name
+   * @return ticket to check the result with
+   */
+  std::shared_ptr<Ticket> submit(std::filesystem::path staging, std::filesystem::path target, int wake_fd,
+                                 int fd = -1);
+
+  /**
+   * @param ticket ticket of submitted upload
+   * @return errno of the commit, 0 on success, nullopt if it is not done yet
+   */
+  [[nodiscard]] std::optional<int> result(const Ticket &ticket) const;
+
+  /**
+   * @brief Waits until upload is committed
+   * @param ticket ticket of submitted upload
+   * @return errno of the commit, 0 on success
+   */
+  int wait(const Ticket &ticket) const;
+
+  /**
+   * @return number of uploads taken by the commit thread
+   */
+  [[nodiscard]] uint64_t getCommits() const { return mCommits.load(std::memory_order_relaxed); }
+
+  /**
+   * @return number of syncs issued for them
+   */
+  [[nodiscard]] uint64_t getSyncs() const { return mSyncs.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Publishes file under its name atomically, fails if there already is file of that name
+   * @param staging fully written file under its temporary name
+   * @param target name the file is published under
+   * @return 0 on success, errno otherwise
+   */
+  static int publish(const std::filesystem::path &staging, const std::filesystem::path &target);
+};
+
+#endif//ISA_PROJECT_GROUPCOMMIT_H
@@ -2,6 +2,11 @@
 
 #include "IInputWrapper.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "ByteSearch.h"
+
 void NetAscii::InputWrapper::push(char *os, char c, std::streamsize n) {
   switch (c) {
     case '\r':
@@ -34,6 +39,32 @@ void NetAscii::InputWrapper::flush(char *os, std::streamsize n) {
   }
 }
 
+void NetAscii::InputWrapper::read(char *os, std::streamsize n) {
+  flush(os, n);
+
+  while (mSize != n) {
+    if (mChunkStart == mChunkEnd) {
+      if (mChunk.empty()) mChunk.resize(CHUNK_SIZE);
+      mChunkStart = 0;
+      mChunkEnd = readChunk(mChunk.data(), CHUNK_SIZE);
+      if (mChunkEnd == 0) {
+        mEnd = true;
+        break;
+      }
+    }
+
+    // run up to the next character to be expanded is copied as is
+    const char *run = mChunk.data() + mChunkStart;
+    size_t limit = std::min(mChunkEnd - mChunkStart, static_cast<size_t>(n - mSize));
+    size_t length = ByteSearch::findEither(run, limit, '\r', '\n');
+    std::memcpy(os + mSize, run, length);
+    mSize += static_cast<std::streamsize>(length);
+    mChunkStart += length;
+
+    if (length < limit) push(os, mChunk[mChunkStart++], n);
+  }
+}
+
 NetAscii::InputFile::InputFile(const std::string &filename) {
   mFile.open(filename, std::ios::binary);
 }
@@ -43,34 +74,14 @@ NetAscii::InputFile::~InputFile() {
 }
 
 
-void NetAscii::InputFile::read(char *os, std::streamsize n) {
-  flush(os, n);
-
-  while (!mFile.eof() && mSize != n) {
-    char c;
-
-    mFile.get(c);
-    if (mFile.eof()) {
-      break;
-    }
-
-    push(os, c, n);
-  }
+std::streamsize NetAscii::InputFile::readChunk(char *buffer, std::streamsize n) {
+  mFile.read(buffer, n);
+  return mFile.gcount();
 }
 
-void NetAscii::InputStdin::read(char *os, std::streamsize n) {
-  flush(os, n);
-
-  while (!std::cin.eof() && mSize != n) {
-    char c;
-
-    std::cin.get(c);
-    if (std::cin.eof()) {
-      break;
-    }
-
-    push(os, c, n);
-  }
+std::streamsize NetAscii::InputStdin::readChunk(char *buffer, std::streamsize n) {
+  std::cin.read(buffer, n);
+  return std::cin.gcount();
 }
 
 Octet::InputFile::InputFile(const std::string &filename) {
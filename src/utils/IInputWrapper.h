@@ -31,6 +31,13 @@ public:
      */
   virtual void read(char *os, std::streamsize n) = 0;
 
+  /**
+   * @param n number of characters to be read
+   * @return true if read(n) can be served without waiting, wrappers reading in the background
+   * notify the owner once it can
+   */
+  [[nodiscard]] virtual bool ready([[maybe_unused]] std::streamsize n) { return true; }
+
   /**
    * @return true if input stream is open
    */
@@ -47,6 +54,14 @@ public:
  */
 namespace NetAscii {
   class InputWrapper : public IInputWrapper {
+    static constexpr std::streamsize CHUNK_SIZE = 65536;
+
+    // raw input read ahead in large chunks, unconsumed part is between mChunkStart and mChunkEnd
+    std::vector<char> mChunk;
+    size_t mChunkStart = 0;
+    size_t mChunkEnd = 0;
+    bool mEnd = false;
+
   protected:
     std::optional<char> mLastChar = std::nullopt;
     /**
@@ -63,6 +78,25 @@ namespace NetAscii {
      * @param n number of characters to read
      */
     void flush(char *os, std::streamsize n);
+
+    /**
+     * @brief reads raw input
+     * @param buffer buffer to read into
+     * @param n size of the buffer
+     * @return number of characters read, less than n only at the end of input
+     */
+    virtual std::streamsize readChunk(char *buffer, std::streamsize n) = 0;
+
+  public:
+    /**
+     * @brief reads n characters converted to netascii, runs without CR and LF are found
+     * by vectorized search and copied at once
+     * @param os array to store characters in
+     * @param n number of characters to read
+     */
+    void read(char *os, std::streamsize n) override;
+
+    bool eof() const override { return mEnd && mChunkStart == mChunkEnd && !mLastChar.has_value(); }
   };
 
   /**
@@ -71,22 +105,24 @@ namespace NetAscii {
   class InputFile : public InputWrapper {
     std::ifstream mFile;
 
+  protected:
+    std::streamsize readChunk(char *buffer, std::streamsize n) override;
+
   public:
     explicit InputFile(const std::string &filename);
     ~InputFile() override;
-    void read(char *os, std::streamsize n) override;
     bool is_open() const override { return mFile.is_open(); }
-    bool eof() const override { return mFile.eof(); }
   };
 
   /**
    * @brief Wrapper for netascii stdin input
    */
   class InputStdin : public InputWrapper {
+  protected:
+    std::streamsize readChunk(char *buffer, std::streamsize n) override;
+
   public:
     ~InputStdin() override = default;
-    void read(char *os, std::streamsize n) override;
-    bool eof() const override { return std::cin.eof(); }
   };
 }// namespace NetAscii
 
@@ -2,56 +2,130 @@
 
 #include "IOutputWrapper.h"
 
-namespace NetAscii {
-  OutputFile::OutputFile(const std::string &filename) {
-    mFile.open(filename, std::ios::binary);
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "ByteSearch.h"
+
+BufferedFile::BufferedFile(const std::string &filename) : mBuffer(BUFFER_SIZE) {
+  mFd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+BufferedFile::~BufferedFile() {
+  if (mFd < 0) return;
+  flush();
+  close(mFd);
+}
+
+void BufferedFile::writeOut(const char *data, size_t size) {
+  while (size > 0 && !mFailed) {
+    ssize_t written = ::write(mFd, data, size);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      mFailed = true;
+      return;
+    }
+    data += written;
+    size -= written;
   }
+}
 
-  OutputFile::~OutputFile() {
-    mFile.close();
+void BufferedFile::write(const char *data, size_t size) {
+  if (mFd < 0) return;
+  if (mBuffered + size > mBuffer.size()) flush();
+  if (size >= mBuffer.size()) {
+    writeOut(data, size);
+    return;
   }
 
-  void OutputFile::write(const std::vector<uint8_t> &buffer) {
+  std::memcpy(mBuffer.data() + mBuffered, data, size);
+  mBuffered += size;
+}
 
-    for (auto c: buffer) {
-      if (c == '\r') {
-        if (mWasCr) mFile << '\r';
-        mWasCr = true;
-        continue;
-      }
+bool BufferedFile::flush() {
+  if (mFd < 0) return false;
+  writeOut(mBuffer.data(), mBuffered);
+  mBuffered = 0;
+  return !mFailed;
+}
 
+int BufferedFile::release() {
+  int fd = mFd;
+  bool flushed = flush();
+  mFd = -1;
+  if (flushed) return fd;
+
+  if (fd >= 0) close(fd);
+  return -1;
+}
+
+namespace NetAscii {
+  OutputFile::OutputFile(const std::string &filename) : mFile(filename) {}
+
+  bool OutputFile::flush() {
+    // CR still waiting for its pair stays pending, the same as when the file is closed
+    return mFile.flush();
+  }
+
+  int OutputFile::release() {
+    return mFile.release();
+  }
+
+  void OutputFile::write(std::span<const uint8_t> buffer) {
+    auto data = reinterpret_cast<const char *>(buffer.data());
+    size_t size = buffer.size();
+
+    size_t idx = 0;
+    while (idx < size) {
       if (mWasCr) {
+        char c = data[idx++];
         switch (c) {
+          case '\r':
+            mFile.write("\r", 1);
+            continue;
           case '\n':
-            mFile << '\n';
-            mWasCr = false;
+            mFile.write("\n", 1);
             break;
           case '\0':
-            mFile << '\r';
-            mWasCr = false;
+            mFile.write("\r", 1);
             break;
           default:
-            mFile << '\r' << c;
-            mWasCr = false;
+            mFile.write("\r", 1);
+            mFile.write(&c, 1);
             break;
         }
-      } else {
-        mFile << c;
+        mWasCr = false;
+        continue;
+      }
+
+      // run up to the next CR is copied as is
+      size_t length = ByteSearch::findEither(data + idx, size - idx, '\r', '\r');
+      mFile.write(data + idx, length);
+      idx += length;
+
+      if (idx < size) {
+        mWasCr = true;
+        idx++;
       }
     }
   }
 }// namespace NetAscii
 
 namespace Octet {
-  OutputFile::OutputFile(const std::string &filename) {
-    mFile.open(filename, std::ios::binary);
+  OutputFile::OutputFile(const std::string &filename) : mFile(filename) {}
+
+  bool OutputFile::flush() {
+    return mFile.flush();
   }
 
-  OutputFile::~OutputFile() {
-    mFile.close();
+  int OutputFile::release() {
+    return mFile.release();
   }
 
-  void OutputFile::write(const std::vector<uint8_t> &buffer) {
+  void OutputFile::write(std::span<const uint8_t> buffer) {
     mFile.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
   }
 }// namespace Octet
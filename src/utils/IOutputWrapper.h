@@ -5,6 +5,8 @@
 
 #include <fstream>
 #include <iostream>
+#include <span>
+#include <string>
 #include <vector>
 
 /**
@@ -15,9 +17,9 @@ public:
   virtual ~IOutputWrapper() = default;
   /**
    * @brief writes buffer to output stream
-   * @param buffer
+   * @param buffer e.g. payload still in the receive buffer, it is not kept after the call
    */
-  virtual void write(const std::vector<uint8_t> &buffer) = 0;
+  virtual void write(std::span<const uint8_t> buffer) = 0;
   /**
    * @return true if output stream is open
    */
@@ -26,36 +28,107 @@ public:
    * @return true if output stream is in good state
    */
   virtual bool good() const = 0;
+  /**
+   * @brief writes out everything written so far and waits until it is done
+   * @return true if all data were written successfully
+   */
+  virtual bool flush() = 0;
+  /**
+   * @brief flushes the output and hands its descriptor over to the caller, nothing can be written afterwards
+   * @return descriptor of the written file, the caller closes it, -1 if the output failed
+   */
+  virtual int release() = 0;
+};
+
+/**
+ * @brief Output file written by descriptor through a buffer, so small blocks do not cost a syscall each
+ */
+class BufferedFile {
+  static constexpr size_t BUFFER_SIZE = 65536;
+
+  int mFd;
+  bool mFailed = false;
+  std::vector<char> mBuffer;
+  size_t mBuffered = 0;
+
+  /**
+   * @brief writes data straight to the file, retries short writes
+   * @param data data to write
+   * @param size number of bytes
+   */
+  void writeOut(const char *data, size_t size);
+
+public:
+  /**
+   * @brief BufferedFile constructor, creates or truncates the file
+   * @param filename path of the file
+   */
+  explicit BufferedFile(const std::string &filename);
+
+  BufferedFile(const BufferedFile &) = delete;
+  BufferedFile &operator=(const BufferedFile &) = delete;
+
+  /**
+   * @brief writes out the buffer and closes the file unless it was released
+   */
+  ~BufferedFile();
+
+  [[nodiscard]] bool is_open() const { return mFd >= 0; }
+
+  [[nodiscard]] bool good() const { return mFd >= 0 && !mFailed; }
+
+  /**
+   * @brief appends data to the buffer, writes the buffer out when it is full
+   * @param data data to write
+   * @param size number of bytes
+   */
+  void write(const char *data, size_t size);
+
+  /**
+   * @brief writes out the buffer
+   * @return true if all data were written successfully
+   */
+  bool flush();
+
+  /**
+   * @brief writes out the buffer and hands the descriptor over to the caller
+   * @return descriptor, -1 if some write failed, the file is closed then
+   */
+  int release();
 };
 
 namespace NetAscii {
   class OutputFile : public IOutputWrapper {
     char mWasCr = false;
-    std::ofstream mFile;
+    // decoded output waiting to be written at once
+    BufferedFile mFile;
 
   public:
     bool is_open() const override { return mFile.is_open(); }
     bool good() const override { return mFile.good(); }
+    bool flush() override;
+    int release() override;
     explicit OutputFile(const std::string &filename);
-    ~OutputFile() override;
     /**
-     * @brief writes buffer, converted from netascii to unix format, to output stream
+     * @brief writes buffer, converted from netascii to unix format, to output stream, runs without CR are found
+     * by vectorized search and copied at once, CR at the end of the buffer is resolved by the next one
      * @param buffer buffer to be written
      */
-    void write(const std::vector<uint8_t> &buffer) override;
+    void write(std::span<const uint8_t> buffer) override;
   };
 }// namespace NetAscii
 
 namespace Octet {
   class OutputFile : public IOutputWrapper {
-    std::ofstream mFile;
+    BufferedFile mFile;
 
   public:
     bool is_open() const override { return mFile.is_open(); }
     bool good() const override { return mFile.good(); }
+    bool flush() override;
+    int release() override;
     explicit OutputFile(const std::string &filename);
-    ~OutputFile() override;
-    void write(const std::vector<uint8_t> &buffer) override;
+    void write(std::span<const uint8_t> buffer) override;
   };
 }// namespace Octet
 
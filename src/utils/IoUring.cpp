@@ -0,0 +1,111 @@
+// Matej Sirovatka, xsirov00
+
+#include "IoUring.h"
+
+#ifdef IO_URING_SUPPORTED
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+IoUring::IoUring(unsigned entries) {
+  io_uring_params params{};
+  int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (fd < 0) return;
+
+  mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    mSqRingSize = mCqRingSize = std::max(mSqRingSize, mCqRingSize);
+  }
+
+  mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (mSqRing == MAP_FAILED) {
+    mSqRing = nullptr;
+    close(fd);
+    return;
+  }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    mCqRing = mSqRing;
+  } else {
+    mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (mCqRing == MAP_FAILED) {
+      mCqRing = nullptr;
+      munmap(mSqRing, mSqRingSize);
+      mSqRing = nullptr;
+      close(fd);
+      return;
+    }
+  }
+
+  mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    if (mCqRing != mSqRing) munmap(mCqRing, mCqRingSize);
+    munmap(mSqRing, mSqRingSize);
+    mSqRing = mCqRing = nullptr;
+    close(fd);
+    return;
+  }
+  mSqes = static_cast<io_uring_sqe *>(sqes);
+
+  auto sq = static_cast<uint8_t *>(mSqRing);
+  mSqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  mSqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  mSqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  mSqEntries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+  mSqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+  auto cq = static_cast<uint8_t *>(mCqRing);
+  mCqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  mCqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  mCqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  mCqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  mRingFd = fd;
+}
+
+IoUring::~IoUring() {
+  if (mSqes) munmap(mSqes, mSqesSize);
+  if (mCqRing && mCqRing != mSqRing) munmap(mCqRing, mCqRingSize);
+  if (mSqRing) munmap(mSqRing, mSqRingSize);
+  if (mRingFd >= 0) close(mRingFd);
+}
+
+io_uring_sqe *IoUring::getSqe() {
+  unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+  unsigned tail = *mSqTail + mToSubmit;
+  if (tail - head >= mSqEntries) return nullptr;
+
+  unsigned index = tail & mSqMask;
+  io_uring_sqe *sqe = &mSqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  mSqArray[index] = index;
+  mToSubmit++;
+  return sqe;
+}
+
+unsigned IoUring::available() const {
+  unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+  return mSqEntries - (*mSqTail + mToSubmit - head);
+}
+
+int IoUring::submit(unsigned wait_nr) {
+  if (mToSubmit) {
+    __atomic_store_n(mSqTail, *mSqTail + mToSubmit, __ATOMIC_RELEASE);
+    mToSubmit = 0;
+  }
+
+  // also covers entries left over from partially failed submit
+  unsigned to_submit = *mSqTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+  if (to_submit == 0 && wait_nr == 0) return 0;
+
+  unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+  return static_cast<int>(syscall(__NR_io_uring_enter, mRingFd, to_submit, wait_nr, flags, nullptr, 0));
+}
+
+#endif
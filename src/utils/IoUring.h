@@ -0,0 +1,104 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_IOURING_H
+#define ISA_PROJECT_IOURING_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define IO_URING_SUPPORTED
+#endif
+
+#ifdef IO_URING_SUPPORTED
+
+/**
+ * @brief Minimal io_uring instance driven directly through the io_uring_setup/io_uring_enter syscalls
+ */
+class IoUring {
+  int mRingFd = -1;
+
+  void *mSqRing = nullptr;
+  size_t mSqRingSize = 0;
+  void *mCqRing = nullptr;
+  size_t mCqRingSize = 0;
+  io_uring_sqe *mSqes = nullptr;
+  size_t mSqesSize = 0;
+
+  unsigned *mSqHead = nullptr;
+  unsigned *mSqTail = nullptr;
+  unsigned mSqMask = 0;
+  unsigned mSqEntries = 0;
+  unsigned *mSqArray = nullptr;
+
+  unsigned *mCqHead = nullptr;
+  unsigned *mCqTail = nullptr;
+  unsigned mCqMask = 0;
+  io_uring_cqe *mCqes = nullptr;
+
+  // entries prepared by getSqe() but not yet passed to the kernel
+  unsigned mToSubmit = 0;
+
+public:
+  /**
+   * @brief IoUring constructor, creates and maps the rings
+   * @param entries number of submission queue entries
+   */
+  explicit IoUring(unsigned entries);
+
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  ~IoUring();
+
+  /**
+   * @return true if the ring was set up successfully
+   */
+  [[nodiscard]] bool is_open() const { return mRingFd >= 0; }
+
+  /**
+   * @brief Gets zeroed submission queue entry to be filled by the caller
+   * @return submission queue entry, nullptr if submission queue is full
+   */
+  io_uring_sqe *getSqe();
+
+  /**
+   * @return number of submission queue entries getSqe() can still return before submit
+   */
+  [[nodiscard]] unsigned available() const;
+
+  /**
+   * @brief Submits all prepared entries and optionally waits for completions
+   * @param wait_nr number of completions to wait for
+   * @return number of submitted entries, -1 on error with errno set
+   */
+  int submit(unsigned wait_nr = 0);
+
+  /**
+   * @brief Calls handler for every completion waiting in the completion queue and consumes it
+   * @tparam F callable taking (uint64_t user_data, int32_t result)
+   * @param handler handler to be called
+   * @return number of consumed completions
+   */
+  template<typename F>
+  unsigned forEachCompletion(F handler) {
+    unsigned head = *mCqHead;
+    unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+
+    while (head != tail) {
+      const io_uring_cqe &cqe = mCqes[head & mCqMask];
+      handler(cqe.user_data, cqe.res);
+      head++;
+      count++;
+    }
+
+    __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+    return count;
+  }
+};
+
+#endif
+
+#endif//ISA_PROJECT_IOURING_H
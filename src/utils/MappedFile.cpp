@@ -0,0 +1,100 @@
+// Matej Sirovatka, xsirov00
+
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+
+namespace {
+  // set while the thread copies from a mapping, the SIGBUS handler jumps back to the copy,
+  // volatile keeps the compiler from dropping the store as dead around the copy
+  thread_local sigjmp_buf *volatile tCopyGuard = nullptr;
+
+  void sigbusHandler(int signum) {
+    if (tCopyGuard) siglongjmp(*tCopyGuard, 1);
+
+    // fault outside of copy() is not ours, it kills the process once the access is retried
+    signal(signum, SIG_DFL);
+  }
+
+  void installSigbusHandler() {
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+      struct sigaction sa = {};
+      sa.sa_handler = sigbusHandler;
+      sigemptyset(&sa.sa_mask);
+      sigaction(SIGBUS, &sa, nullptr);
+    });
+  }
+}// namespace
+
+MappedFile::~MappedFile() {
+  if (mData) munmap(const_cast<uint8_t *>(mData), mSize);
+  if (mFd >= 0) close(mFd);
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return nullptr;
+
+  struct stat info = {};
+  if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+    close(fd);
+    return nullptr;
+  }
+
+  // empty file cannot be mapped, but there is nothing to read anyway
+  auto size = static_cast<size_t>(info.st_size);
+  if (size == 0) {
+    close(fd);
+    return std::shared_ptr<MappedFile>(new MappedFile(-1, nullptr, 0, info.st_dev, info.st_ino));
+  }
+
+  void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    close(fd);
+    return nullptr;
+  }
+
+  installSigbusHandler();
+  madvise(data, size, MADV_SEQUENTIAL);
+  return std::shared_ptr<MappedFile>(
+          new MappedFile(fd, static_cast<const uint8_t *>(data), size, info.st_dev, info.st_ino));
+}
+
+bool MappedFile::isTruncated() const {
+  struct stat info = {};
+  return mFd >= 0 && fstat(mFd, &info) == 0 && static_cast<size_t>(info.st_size) < mSize;
+}
+
+bool MappedFile::copy(size_t offset, size_t length, uint8_t *destination) const {
+  sigjmp_buf guard;
+  // signal mask is restored by the jump, SIGBUS stays blocked otherwise
+  if (sigsetjmp(guard, 1) != 0) {
+    tCopyGuard = nullptr;
+    return false;
+  }
+
+  tCopyGuard = &guard;
+  memcpy(destination, mData + offset, length);
+  tCopyGuard = nullptr;
+  return true;
+}
+
+void MappedFile::prefetch(size_t offset, size_t length) const {
+  if (offset >= mSize) return;
+  length = std::min(length, mSize - offset);
+
+  // madvise needs page aligned start
+  static const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t start = offset - offset % page_size;
+  madvise(const_cast<uint8_t *>(mData) + start, length + offset - start, MADV_WILLNEED);
+}
@@ -0,0 +1,80 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_MAPPEDFILE_H
+#define ISA_PROJECT_MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Read-only memory mapping of a whole file, pages are shared with the page cache,
+ * pages past the end of the file truncated while it is mapped raise SIGBUS when touched,
+ * so the mapping is only read by copy(), which survives it, or by the kernel, whose send fails with EFAULT
+ */
+class MappedFile {
+  // kept open to check the size of the file
+  int mFd = -1;
+  const uint8_t *mData = nullptr;
+  size_t mSize = 0;
+  // identity of the mapped file, the path may point to other file by now
+  uint64_t mDevice = 0;
+  uint64_t mInode = 0;
+
+  MappedFile(int fd, const uint8_t *data, size_t size, uint64_t device, uint64_t inode)
+      : mFd(fd), mData(data), mSize(size), mDevice(device), mInode(inode) {}
+
+public:
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile();
+
+  /**
+   * @brief Maps the file
+   * @param path path of the file
+   * @return mapped file, nullptr if the file is not a regular file or cannot be mapped
+   */
+  static std::shared_ptr<MappedFile> open(const std::string &path);
+
+  /**
+   * @return start of the mapping, nullptr for empty file
+   */
+  [[nodiscard]] const uint8_t *data() const { return mData; }
+
+  /**
+   * @return size of the file
+   */
+  [[nodiscard]] size_t size() const { return mSize; }
+
+  /**
+   * @param device device of the file
+   * @param inode inode of the file
+   * @return true if this mapping is of the given file
+   */
+  [[nodiscard]] bool isOf(uint64_t device, uint64_t inode) const { return mDevice == device && mInode == inode; }
+
+  /**
+   * @return true if the file is shorter than the mapping by now
+   */
+  [[nodiscard]] bool isTruncated() const;
+
+  /**
+   * @brief Copies part of the file, SIGBUS raised by the file truncated meanwhile is caught
+   * @param offset start of the part
+   * @param length length of the part, it has to lie within the mapping
+   * @param destination buffer of at least length bytes
+   * @return false if the part was truncated away, destination is partially written then
+   */
+  bool copy(size_t offset, size_t length, uint8_t *destination) const;
+
+  /**
+   * @brief Asks the kernel to read part of the file in the background, so later accesses do not wait for the disk
+   * @param offset start of the part
+   * @param length length of the part, clamped to the end of the file
+   */
+  void prefetch(size_t offset, size_t length) const;
+};
+
+#endif//ISA_PROJECT_MAPPEDFILE_H
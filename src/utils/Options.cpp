@@ -2,145 +2,132 @@
 
 #include "Options.h"
 
+#include <algorithm>
+#include <charconv>
+
+namespace {
+  /**
+   * @brief Reads zero terminated string and advances the index past the terminator
+   * @param data serialized options
+   * @param idx index of the string, moved after its terminator
+   * @return view of the string, throws InvalidFormatException if there is no terminator
+   */
+  std::string_view readString(std::span<const uint8_t> data, size_t &idx) {
+    auto begin = data.begin() + static_cast<long>(idx);
+    auto end = std::find(begin, data.end(), 0);
+    if (end == data.end()) throw Options::InvalidFormatException();
+
+    std::string_view result(reinterpret_cast<const char *>(&*begin), end - begin);
+    idx += result.size() + 1;
+    return result;
+  }
+
+  /**
+   * @brief Formats number without allocation
+   * @param buffer buffer big enough for any long
+   * @param value number to be formatted
+   * @return view of the formatted number in the buffer
+   */
+  std::string_view formatNumber(std::array<char, 24> &buffer, long value) {
+    auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    return {buffer.data(), static_cast<size_t>(result.ptr - buffer.data())};
+  }
+}// namespace
+
 namespace Options {
-  map_t parse(std::vector<uint8_t> data, int start) {
-    map_t options = {};
-
-    bool inKey = true;
-    std::string key;
-    std::string value;
-    int numOptions = 0;
-
-    for (int idx = start; idx < data.size(); idx++) {
-      if (data[idx] == 0) {
-        if (inKey) {
-          inKey = false;
-        } else {
-          options[numOptions++] = std::tuple(key, value, false);
-          key.clear();
-          value.clear();
-          inKey = true;
-          continue;
-        }
-      } else {
-        if (inKey) {
-          key += static_cast<char>(data[idx]);
-        } else {
-          value += static_cast<char>(data[idx]);
-        }
-      }
+  void Set::update(const Set &other) {
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+      if (other.isSet(static_cast<Key>(i))) set(static_cast<Key>(i), other.mValues[i]);
     }
+  }
 
-    if (!key.empty()) throw InvalidFormatException();
-    if (!value.empty()) throw InvalidFormatException();
+  std::chrono::microseconds Set::getTimeout() const {
+    if (isSet(Key::UTIMEOUT)) return std::chrono::microseconds(get(Key::UTIMEOUT));
+    return std::chrono::seconds(get(Key::TIMEOUT));
+  }
 
-    if (!inKey) throw InvalidFormatException();
+  Set parse(std::span<const uint8_t> data) {
+    Set options;
 
-    return options;
-  }
+    size_t idx = 0;
+    while (idx < data.size()) {
+      auto key = readString(data, idx);
+      auto value = readString(data, idx);
+
+      auto name = std::find(NAMES.begin(), NAMES.end(), key);
+      if (name == NAMES.end()) continue;
+      auto i = static_cast<size_t>(name - NAMES.begin());
 
-  map_t create(long blksize, long timeout, long tsize) {
-    map_t options;
+      long result;
+      try {
+        result = validateInRange(std::string(value), MINIMUMS[i], MAXIMUMS[i]);
+      } catch (InvalidValueException &e) {
+        if (!ACKNOWLEDGE_INVALID[i]) continue;
+        result = DEFAULTS[i];
+      }
 
-    options[0] = std::tuple("blksize", blksize, false);
-    options[1] = std::tuple("timeout", timeout, false);
-    options[2] = std::tuple("tsize", tsize, false);
+      options.set(static_cast<Key>(i), result);
+    }
 
     return options;
   }
 
-  std::vector<uint8_t> serialize(const map_t &options) {
-    std::vector<uint8_t> output;
+  size_t serializedSize(const Set &options) {
+    std::array<char, 24> number{};
+    size_t size = 0;
 
-    for (const auto &[order, item]: options) {
-      const auto &[key, value, set] = item;
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+      auto key = static_cast<Key>(i);
+      if (!options.isSet(key)) continue;
+      size += NAMES[i].size() + 1 + formatNumber(number, options.get(key)).size() + 1;
+    }
+    return size;
+  }
 
-      output.insert(output.end(), key.begin(), key.end());
-      output.push_back(0);
+  size_t serializeInto(const Set &options, std::span<uint8_t> buffer) {
+    std::array<char, 24> number{};
+    uint8_t *output = buffer.data();
 
-      if (std::holds_alternative<std::string>(value)) {
-        const auto &str = std::get<std::string>(value);
-        output.insert(output.end(), str.begin(), str.end());
-      } else {
-        const auto &num = std::get<long>(value);
-        const auto &str = std::to_string(num);
-        output.insert(output.end(), str.begin(), str.end());
-      }
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+      auto key = static_cast<Key>(i);
+      if (!options.isSet(key)) continue;
 
-      output.push_back(0);
+      output = std::copy(NAMES[i].begin(), NAMES[i].end(), output);
+      *output++ = 0;
+      auto value = formatNumber(number, options.get(key));
+      output = std::copy(value.begin(), value.end(), output);
+      *output++ = 0;
     }
-    return output;
+    return output - buffer.data();
   }
 
-  std::string format(const map_t &options) {
+  std::string format(const Set &options) {
     std::string result;
 
-    for (auto &[order, item]: options) {
-      auto &[key, value, set] = item;
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+      auto key = static_cast<Key>(i);
+      if (!options.isSet(key)) continue;
 
-      if (std::holds_alternative<std::string>(value)) {
-        result += key + "=" + std::get<std::string>(value);
-      } else {
-        result += key + "=" + std::to_string(std::get<long>(value));
-      }
-
-      result += " ";
+      if (!result.empty()) result += " ";
+      result += std::string(NAMES[i]) + "=" + std::to_string(options.get(key));
     }
 
-    result.pop_back();
     return result;
   }
 
-  map_t validate(const map_t &options) {
-    map_t validated{};
-
-    validated[0] = std::tuple("blksize", 512, false);
-    validated[1] = std::tuple("timeout", 5, false);
-    validated[2] = std::tuple("tsize", 0, false);
+  std::string format(std::span<const uint8_t> data) {
+    std::string result;
 
-    for (const auto &[order, item]: options) {
-      const auto &[key, value, set] = item;
-      long result;
+    size_t idx = 0;
+    while (idx < data.size()) {
+      auto key = readString(data, idx);
+      auto value = readString(data, idx);
 
-      // we expect this to be called only as it holds only string values
-      auto str = std::get<std::string>(value);
-
-      if (key == "blksize") {
-        try {
-          result = validateInRange(str, 8, 65464);
-        } catch (InvalidValueException &e) {
-          result = 512;
-        }
-        validated[0] = std::tuple("blksize", result, true);
-      } else if (key == "timeout") {
-        try {
-          result = validateInRange(str, 1, 255);
-        } catch (InvalidValueException &e) {
-          result = 5;
-        }
-        validated[1] = std::tuple("timeout", result, true);
-      } else if (key == "tsize") {
-        try {
-          result = validateInRange(str, 0, 4294967295);
-        } catch (InvalidValueException &e) {
-          result = 0;
-        }
-        validated[2] = std::tuple("tsize", result, true);
-      }
+      if (!result.empty()) result += " ";
+      result += std::string(key) + "=" + std::string(value);
     }
-    return validated;
-  }
 
-  long get(const std::string &key, const map_t &options) {
-    for (const auto &[order, item]: options) {
-      const auto &[key_, value, set] = item;
-      if (key == key_) {
-        return std::get<long>(value);
-      }
-    }
-
-    // unreachable
-    return 0;
+    return result;
   }
 
   long validateInRange(const std::string &value, long min, long max) {
@@ -157,20 +144,4 @@ namespace Options {
 
     return result;
   }
-
-  bool isAny(const map_t &options) {
-    for (auto &[order, item]: options) {
-      auto &[key, value, set] = item;
-      if (set) return true;
-    }
-    return false;
-  }
-
-  bool isSet(const std::string &key, const map_t &options) {
-    for (auto &[order, item]: options) {
-      auto &[key_, value, set] = item;
-      if (key == key_ && set) return true;
-    }
-    return false;
-  }
 }// namespace Options
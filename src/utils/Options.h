@@ -3,17 +3,38 @@
 #ifndef ISA_PROJECT_OPTIONS_H
 #define ISA_PROJECT_OPTIONS_H
 
-#include <iostream>
-#include <map>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <span>
 #include <stdexcept>
 #include <string>
-#include <variant>
-#include <vector>
+#include <string_view>
 
 
 namespace Options {
-  using value_t = std::variant<std::string, long>;
-  using map_t = std::map<int, std::tuple<std::string, value_t, bool>>;
+  // largest windowsize acknowledged by the server, bounds blocks kept in memory per transfer
+  constexpr long MAX_WINDOWSIZE = 64;
+
+  /**
+   * @brief Options known to the server and the client, in the order they are serialized
+   */
+  enum class Key : uint8_t { BLKSIZE, TIMEOUT, TSIZE, UTIMEOUT, WINDOWSIZE, COUNT };
+
+  constexpr size_t KEY_COUNT = static_cast<size_t>(Key::COUNT);
+
+  // names of the options on the wire, indexed by Key
+  constexpr std::array<std::string_view, KEY_COUNT> NAMES = {"blksize", "timeout", "tsize", "utimeout", "windowsize"};
+
+  // values used while the option is not negotiated
+  constexpr std::array<long, KEY_COUNT> DEFAULTS = {512, 5, 0, 0, 1};
+
+  // accepted ranges of values, utimeout matches tftp-hpa
+  constexpr std::array<long, KEY_COUNT> MINIMUMS = {8, 1, 0, 10000, 1};
+  constexpr std::array<long, KEY_COUNT> MAXIMUMS = {65464, 255, 4294967295, 255000000, 65535};
+
+  // invalid value of these options is acknowledged with the default, the others are not acknowledged at all
+  constexpr std::array<bool, KEY_COUNT> ACKNOWLEDGE_INVALID = {true, true, true, false, false};
 
   /**
    * @brief Exception thrown when invalid option format is detected
@@ -32,50 +53,97 @@ namespace Options {
   };
 
   /**
-   * @brief parses options from buffer
-   * @param data buffer of bytes
-   * @param start starting index
-   * @return parsed options
+   * @brief Values of all known options, with a presence bit for each of them, only present options
+   * are requested or acknowledged, lookup is a plain field load
    */
-  map_t parse(std::vector<uint8_t> data, int start);
+  class Set {
+    std::array<long, KEY_COUNT> mValues = DEFAULTS;
+    uint8_t mPresent = 0;
+
+    static constexpr size_t index(Key key) { return static_cast<size_t>(key); }
+
+  public:
+    /**
+     * @param key key of the option
+     * @return value of the option, default if it is not present
+     */
+    [[nodiscard]] long get(Key key) const { return mValues[index(key)]; }
+
+    /**
+     * @brief sets option value and marks it as present
+     * @param key key of the option
+     * @param value value to be set
+     */
+    void set(Key key, long value) {
+      mValues[index(key)] = value;
+      mPresent |= 1u << index(key);
+    }
+
+    /**
+     * @brief sets value used while the option is not negotiated, the option stays absent
+     * @param key key of the option
+     * @param value value to be set
+     */
+    void setDefault(Key key, long value) { mValues[index(key)] = value; }
+
+    /**
+     * @param key key of the option
+     * @return true if the option is present
+     */
+    [[nodiscard]] bool isSet(Key key) const { return mPresent & (1u << index(key)); }
+
+    /**
+     * @return true if any option is present
+     */
+    [[nodiscard]] bool isAny() const { return mPresent != 0; }
+
+    /**
+     * @brief copies options present in other set
+     * @param other options to be copied
+     */
+    void update(const Set &other);
+
+    /**
+     * @brief gets retransmission timeout, utimeout takes precedence over timeout if it is set
+     * @return timeout in microseconds
+     */
+    [[nodiscard]] std::chrono::microseconds getTimeout() const;
+  };
 
   /**
-   * @brief creates map of options
-   * @param blksize blocksize
-   * @param timeout timeout
-   * @param tsize tsize
-   * @return map of options with specified values
+   * @brief parses and validates options from buffer, unknown options are skipped
+   * @param data serialized options
+   * @return known options, present if they were requested, throws InvalidFormatException on invalid format
    */
-  map_t create(long blksize, long timeout, long tsize);
+  Set parse(std::span<const uint8_t> data);
 
   /**
-   * @brief serializes options to byte vector
    * @param options options to be serialized
-   * @return byte vector of serialized options
+   * @return size of serialized present options
    */
-  [[nodiscard]] std::vector<uint8_t> serialize(const map_t &options);
+  [[nodiscard]] size_t serializedSize(const Set &options);
 
   /**
-   * @brief formats options to string
-   * @param options options to be formatted
-   * @return formatted string of options
+   * @brief serializes present options
+   * @param options options to be serialized
+   * @param buffer buffer of at least serializedSize() bytes
+   * @return number of written bytes
    */
-  [[nodiscard]] std::string format(const map_t &options);
+  size_t serializeInto(const Set &options, std::span<uint8_t> buffer);
 
   /**
-   * @brief validates options
-   * @param options options to be validated
-   * @return validated options
+   * @brief formats present options to string
+   * @param options options to be formatted
+   * @return formatted string of options
    */
-  [[nodiscard]] map_t validate(const map_t &options);
+  [[nodiscard]] std::string format(const Set &options);
 
   /**
-   * @brief gets option value
-   * @param key key of the option
-   * @param options options to look in
-   * @return long value of the option
+   * @brief formats serialized options as they were received, including unknown ones
+   * @param data serialized options
+   * @return formatted string of options
    */
-  [[nodiscard]] long get(const std::string &key, const map_t &options);
+  [[nodiscard]] std::string format(std::span<const uint8_t> data);
 
   /**
    * @brief validates option value
@@ -85,21 +153,6 @@ namespace Options {
    * @return long value of the option, throws exception if value is invalid
    */
   long validateInRange(const std::string &value, long min, long max);
-
-  /**
-   * @brief checks if any of the options is set
-   * @param options options to be checked
-   * @return true if any is set, false otherwise
-   */
-  bool isAny(const map_t &options);
-
-  /**
-   * @brief checks if option is set
-   * @param key key to check
-   * @param options options to be checked
-   * @return true if value is set, false otherwise
-   */
-  bool isSet(const std::string &key, const map_t &options);
 }// namespace Options
 
 #endif//ISA_PROJECT_OPTIONS_H
@@ -0,0 +1,113 @@
+// Matej Sirovatka, xsirov00
+
+#include "ReadAheadInput.h"
+
+#include <algorithm>
+#include <cstring>
+
+ReadAheadInput::ReadAheadInput(std::unique_ptr<IInputWrapper> source, std::streamsize block_size, size_t blocks,
+                               BufferPool &buffers, FileIoPool &pool, int key) : mState(std::make_shared<State>()),
+                                                                                 mPool(pool),
+                                                                                 mKey(key) {
+  mOpen = source->is_open();
+  mState->mSource = std::move(source);
+  mState->mBlockSize = block_size;
+  mState->mBlocks = std::max(blocks, static_cast<size_t>(2));
+  if (!mOpen) return;
+
+  mState->mRing = buffers.acquire(mState->mBlocks * static_cast<size_t>(block_size));
+  mState->mSizes.resize(mState->mBlocks);
+
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  schedule();
+}
+
+ReadAheadInput::~ReadAheadInput() {
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  mState->mCancelled = true;
+}
+
+void ReadAheadInput::schedule() {
+  State &state = *mState;
+  if (state.mReading || state.mEnd || state.mCancelled || state.mProduced - state.mConsumed == state.mBlocks) return;
+
+  state.mReading = true;
+  mPool.submit([state = mState, pool = &mPool, key = mKey] { produce(state, *pool, key); });
+}
+
+void ReadAheadInput::produce(const std::shared_ptr<State> &state, FileIoPool &pool, int key) {
+  while (true) {
+    size_t index;
+    {
+      std::lock_guard<std::mutex> lock(state->mMutex);
+      if (state->mCancelled || state->mEnd || state->mProduced - state->mConsumed == state->mBlocks) {
+        state->mReading = false;
+        return;
+      }
+      index = state->mProduced % state->mBlocks;
+    }
+
+    // slot is not visible to the consumer until it is counted as produced
+    state->mSource->read(reinterpret_cast<char *>(state->mRing.data()) + index * state->mBlockSize,
+                         state->mBlockSize);
+    std::streamsize size = state->mSource->gcount();
+
+    bool waiting;
+    {
+      std::lock_guard<std::mutex> lock(state->mMutex);
+      state->mSizes[index] = size;
+      state->mProduced++;
+      state->mEnd = size < state->mBlockSize;
+      waiting = state->mWaiting && !state->mCancelled;
+      state->mWaiting = false;
+    }
+    // consumer checks ready() again, it asks to be notified once more if the block was not enough
+    if (waiting) pool.notify(key);
+  }
+}
+
+bool ReadAheadInput::ready(std::streamsize n) {
+  if (!mOpen) return true;
+
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  State &state = *mState;
+  std::streamsize available = -mOffset;
+  for (size_t block = state.mConsumed; block < state.mProduced && available < n; block++) {
+    available += state.mSizes[block % state.mBlocks];
+  }
+  if (available >= n || state.mEnd) return true;
+
+  state.mWaiting = true;
+  schedule();
+  return false;
+}
+
+void ReadAheadInput::read(char *os, std::streamsize n) {
+  mSize = 0;
+  if (!mOpen) return;
+
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  State &state = *mState;
+  while (mSize < n && state.mConsumed < state.mProduced) {
+    size_t index = state.mConsumed % state.mBlocks;
+    std::streamsize length = std::min(n - mSize, state.mSizes[index] - mOffset);
+    std::memcpy(os + mSize, reinterpret_cast<const char *>(state.mRing.data()) + index * state.mBlockSize + mOffset,
+                length);
+    mSize += length;
+    mOffset += length;
+
+    if (mOffset == state.mSizes[index]) {
+      mOffset = 0;
+      state.mConsumed++;
+    }
+  }
+  // freed slots are refilled in the background
+  schedule();
+}
+
+bool ReadAheadInput::eof() const {
+  if (!mOpen) return true;
+
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  return mState->mEnd && mState->mProduced == mState->mConsumed;
+}
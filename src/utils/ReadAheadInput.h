@@ -0,0 +1,107 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_READAHEADINPUT_H
+#define ISA_PROJECT_READAHEADINPUT_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "BufferPool.h"
+#include "FileIoPool.h"
+#include "IInputWrapper.h"
+
+/**
+ * @brief Input wrapper reading its source ahead into a ring of blocks on threads of the file io pool,
+ * so reads of the consumer are served from memory while the disk works in the background,
+ * read never waits, consumer asks ready() first and is notified through the pool once the data are there,
+ * the source is used by a single task at a time
+ */
+class ReadAheadInput : public IInputWrapper {
+  /**
+   * @brief State shared with the task reading ahead, outlives the wrapper while the task runs
+   */
+  struct State {
+    std::unique_ptr<IInputWrapper> mSource;
+    std::streamsize mBlockSize;
+    size_t mBlocks;
+
+    // mBlocks slots of mBlockSize bytes, slot of block i is i % mBlocks
+    BufferPool::Buffer mRing;
+    std::vector<std::streamsize> mSizes;
+
+    std::mutex mMutex;
+    // blocks produced by the task and taken by the consumer, they only grow
+    size_t mProduced = 0;
+    size_t mConsumed = 0;
+    // source returned short block, nothing follows it
+    bool mEnd = false;
+    // task reading ahead is queued or running
+    bool mReading = false;
+    // consumer is waiting for data and has to be notified
+    bool mWaiting = false;
+    // wrapper was destroyed, task stops at the next block
+    bool mCancelled = false;
+  };
+
+  std::shared_ptr<State> mState;
+  bool mOpen;
+  FileIoPool &mPool;
+  int mKey;
+  // read position in the oldest block not fully taken, used only by the consumer
+  std::streamsize mOffset = 0;
+
+  /**
+   * @brief Queues task reading ahead unless one is queued already or the ring is full, called under the lock
+   */
+  void schedule();
+
+  /**
+   * @brief Body of the task, reads blocks while there are free slots
+   * @param state shared state
+   * @param pool pool notifying the consumer
+   * @param key key of the consumer
+   */
+  static void produce(const std::shared_ptr<State> &state, FileIoPool &pool, int key);
+
+public:
+  /**
+   * @brief ReadAheadInput constructor, starts reading right away if the source is open
+   * @param source wrapped input
+   * @param block_size size of single read from the source
+   * @param blocks number of blocks read ahead
+   * @param buffers pool the ring is borrowed from
+   * @param pool threads reading the source
+   * @param key key the consumer is notified under once data it waits for are ready
+   */
+  ReadAheadInput(std::unique_ptr<IInputWrapper> source, std::streamsize block_size, size_t blocks,
+                 BufferPool &buffers, FileIoPool &pool, int key);
+
+  ReadAheadInput(const ReadAheadInput &) = delete;
+  ReadAheadInput &operator=(const ReadAheadInput &) = delete;
+
+  /**
+   * @brief stops reading ahead, the task still running finishes its block in the background
+   */
+  ~ReadAheadInput() override;
+
+  /**
+   * @brief reads up to n characters already read ahead, never waits
+   * @param os array to store characters in
+   * @param n number of characters to read
+   */
+  void read(char *os, std::streamsize n) override;
+
+  /**
+   * @param n number of characters to be read
+   * @return true if read(n) returns n characters or reaches the end, otherwise the consumer is notified
+   * once it does
+   */
+  [[nodiscard]] bool ready(std::streamsize n) override;
+
+  [[nodiscard]] bool is_open() const override { return mOpen; }
+
+  [[nodiscard]] bool eof() const override;
+};
+
+#endif//ISA_PROJECT_READAHEADINPUT_H
@@ -0,0 +1,27 @@
+// Matej Sirovatka, xsirov00
+
+#include "RttEstimator.h"
+
+#include <algorithm>
+
+RttEstimator::RttEstimator(duration initial, duration max) : mMaxTimeout(std::max(max, MIN_TIMEOUT)) {
+  mTimeout = std::clamp(initial, MIN_TIMEOUT, mMaxTimeout);
+}
+
+void RttEstimator::sample(duration rtt) {
+  if (!mHasSample) {
+    mSrtt = rtt;
+    mRttvar = rtt / 2;
+    mHasSample = true;
+  } else {
+    duration error = mSrtt > rtt ? mSrtt - rtt : rtt - mSrtt;
+    mRttvar = (3 * mRttvar + error) / 4;
+    mSrtt = (7 * mSrtt + rtt) / 8;
+  }
+
+  mTimeout = std::clamp(mSrtt + 4 * mRttvar, MIN_TIMEOUT, mMaxTimeout);
+}
+
+void RttEstimator::backoff() {
+  mTimeout = std::min(mTimeout * 2, mMaxTimeout);
+}
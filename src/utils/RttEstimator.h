@@ -0,0 +1,53 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_RTTESTIMATOR_H
+#define ISA_PROJECT_RTTESTIMATOR_H
+
+#include <chrono>
+
+/**
+ * @brief Estimates retransmission timeout from measured round trip times as described in RFC 6298,
+ * timeout is doubled after every retransmission until next valid sample
+ */
+class RttEstimator {
+public:
+  using duration = std::chrono::microseconds;
+
+  // lower bound of the timeout, keeps scheduling jitter from causing retransmissions
+  static constexpr duration MIN_TIMEOUT = std::chrono::milliseconds(10);
+  // timeout before first sample, unless the negotiated timeout is shorter
+  static constexpr duration INITIAL_TIMEOUT = std::chrono::seconds(1);
+
+private:
+  duration mSrtt{0};
+  duration mRttvar{0};
+  duration mTimeout;
+  duration mMaxTimeout;
+  bool mHasSample = false;
+
+public:
+  /**
+   * @brief RttEstimator constructor
+   * @param initial timeout used before first sample is measured
+   * @param max upper bound of the timeout
+   */
+  RttEstimator(duration initial, duration max);
+
+  /**
+   * @brief Updates the estimate, only packets that were not retransmitted should be sampled
+   * @param rtt measured round trip time
+   */
+  void sample(duration rtt);
+
+  /**
+   * @brief Doubles the timeout after retransmission
+   */
+  void backoff();
+
+  /**
+   * @return current retransmission timeout
+   */
+  [[nodiscard]] duration getTimeout() const { return mTimeout; }
+};
+
+#endif//ISA_PROJECT_RTTESTIMATOR_H
@@ -0,0 +1,24 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_SHAREDBYTES_H
+#define ISA_PROJECT_SHAREDBYTES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Bytes not owned by the holder, kept alive by a shared owner for as long as the holder exists
+ */
+struct SharedBytes {
+  std::shared_ptr<const void> mOwner;
+  const uint8_t *mData = nullptr;
+  size_t mSize = 0;
+
+  /**
+   * @return true if no bytes are held
+   */
+  [[nodiscard]] bool empty() const { return mSize == 0; }
+};
+
+#endif//ISA_PROJECT_SHAREDBYTES_H
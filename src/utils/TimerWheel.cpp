@@ -0,0 +1,136 @@
+// Matej Sirovatka, xsirov00
+
+#include "TimerWheel.h"
+
+#include <algorithm>
+
+void TimerWheel::Timer::unlink() {
+  mPrev->mNext = mNext;
+  mNext->mPrev = mPrev;
+  mPrev = mNext = this;
+}
+
+void TimerWheel::Timer::cancel() {
+  if (!mWheel) return;
+
+  unlink();
+  mWheel->mCount--;
+  mWheel = nullptr;
+}
+
+TimerWheel::TimerWheel() : mStart(clock::now()) {}
+
+TimerWheel::~TimerWheel() {
+  // disarm timers that outlive the wheel
+  for (auto &slot: mRoot) {
+    while (slot.mNext != &slot) slot.mNext->cancel();
+  }
+  for (auto &level: mLevels) {
+    for (auto &slot: level) {
+      while (slot.mNext != &slot) slot.mNext->cancel();
+    }
+  }
+}
+
+uint64_t TimerWheel::toTick(clock::time_point time) const {
+  if (time <= mStart) return 0;
+  return std::chrono::duration_cast<std::chrono::milliseconds>(time - mStart).count();
+}
+
+void TimerWheel::insert(Timer &timer) {
+  // timer expiring in the past is handled on the next processed tick
+  if (timer.mExpires < mCurrent) timer.mExpires = mCurrent;
+
+  if (timer.mExpires - mCurrent > MAX_DELAY) timer.mExpires = mCurrent + MAX_DELAY;
+
+  uint64_t delay = timer.mExpires - mCurrent;
+  Timer *slot;
+  if (delay < ROOT_SIZE) {
+    slot = &mRoot[timer.mExpires & (ROOT_SIZE - 1)];
+  } else {
+    unsigned level = 0;
+    while (level + 1 < LEVELS && delay >= 1ull << (ROOT_BITS + (level + 1) * LEVEL_BITS)) level++;
+
+    uint64_t index = (timer.mExpires >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+    slot = &mLevels[level][index];
+  }
+
+  timer.mPrev = slot->mPrev;
+  timer.mNext = slot;
+  slot->mPrev->mNext = &timer;
+  slot->mPrev = &timer;
+}
+
+void TimerWheel::cascade(unsigned level, uint64_t index) {
+  Timer &slot = mLevels[level][index];
+  while (slot.mNext != &slot) {
+    Timer &timer = *slot.mNext;
+    timer.unlink();
+    insert(timer);
+  }
+}
+
+void TimerWheel::arm(Timer &timer, clock::duration delay) {
+  timer.cancel();
+
+  auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+  uint64_t ticks = milliseconds < 0 ? 0 : std::min(static_cast<uint64_t>(milliseconds), MAX_DELAY);
+
+  // current tick has already partially passed, so the timer never expires early
+  timer.mExpires = toTick(clock::now()) + ticks + 1;
+  timer.mWheel = this;
+  mCount++;
+  insert(timer);
+}
+
+void TimerWheel::advance(clock::time_point now) {
+  uint64_t target = toTick(now);
+
+  while (mCurrent <= target) {
+    if (mCount == 0) {
+      mCurrent = target + 1;
+      return;
+    }
+
+    uint64_t index = mCurrent & (ROOT_SIZE - 1);
+    if (index == 0) {
+      for (unsigned level = 0; level < LEVELS; level++) {
+        uint64_t level_index = (mCurrent >> (ROOT_BITS + level * LEVEL_BITS)) & (LEVEL_SIZE - 1);
+        cascade(level, level_index);
+        if (level_index != 0) break;
+      }
+    }
+
+    // detach expired timers first, callbacks are free to arm timers again
+    Timer expired;
+    Timer &slot = mRoot[index];
+    if (slot.mNext != &slot) {
+      expired.mNext = slot.mNext;
+      expired.mPrev = slot.mPrev;
+      expired.mNext->mPrev = &expired;
+      expired.mPrev->mNext = &expired;
+      slot.mNext = slot.mPrev = &slot;
+    }
+    mCurrent++;
+
+    while (expired.mNext != &expired) {
+      Timer &timer = *expired.mNext;
+      timer.cancel();
+      if (timer.mCallback) timer.mCallback();
+    }
+  }
+}
+
+int TimerWheel::nextTimeout(clock::time_point now) const {
+  if (mCount == 0) return -1;
+
+  // first non-empty slot, or the next cascade which may bring timers from upper levels
+  uint64_t tick = mCurrent;
+  while ((tick & (ROOT_SIZE - 1)) != 0 && mRoot[tick & (ROOT_SIZE - 1)].mNext == &mRoot[tick & (ROOT_SIZE - 1)]) {
+    tick++;
+  }
+
+  uint64_t current = toTick(now);
+  if (tick <= current) return 0;
+  return static_cast<int>(tick - current);
+}
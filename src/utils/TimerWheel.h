@@ -0,0 +1,129 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_TIMERWHEEL_H
+#define ISA_PROJECT_TIMERWHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief Hierarchical timer wheel with millisecond ticks, arming and cancelling a timer is O(1),
+ * first level holds timers expiring within 256 ms, three more levels cover up to 2^26 ms
+ */
+class TimerWheel {
+public:
+  using clock = std::chrono::steady_clock;
+
+  /**
+   * @brief Timer owned by the caller, linked into the wheel while it is armed
+   */
+  class Timer {
+    friend class TimerWheel;
+
+    Timer *mPrev = this;
+    Timer *mNext = this;
+    TimerWheel *mWheel = nullptr;
+    uint64_t mExpires = 0;
+    std::function<void()> mCallback;
+
+    /**
+     * @brief Removes timer from the list it is linked into
+     */
+    void unlink();
+
+  public:
+    Timer() = default;
+
+    /**
+     * @brief Timer constructor
+     * @param callback function called when the timer expires
+     */
+    explicit Timer(std::function<void()> callback) : mCallback(std::move(callback)) {}
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    ~Timer() { cancel(); }
+
+    /**
+     * @brief Disarms the timer, does nothing if it is not armed
+     */
+    void cancel();
+
+    /**
+     * @return true if the timer is armed
+     */
+    [[nodiscard]] bool isArmed() const { return mWheel != nullptr; }
+  };
+
+private:
+  static constexpr unsigned ROOT_BITS = 8;
+  static constexpr unsigned LEVEL_BITS = 6;
+  static constexpr unsigned LEVELS = 3;
+  static constexpr uint64_t ROOT_SIZE = 1ull << ROOT_BITS;
+  static constexpr uint64_t LEVEL_SIZE = 1ull << LEVEL_BITS;
+  static constexpr uint64_t MAX_DELAY = (1ull << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+
+  clock::time_point mStart;
+  // next tick to be processed
+  uint64_t mCurrent = 0;
+  size_t mCount = 0;
+
+  std::array<Timer, ROOT_SIZE> mRoot;
+  std::array<std::array<Timer, LEVEL_SIZE>, LEVELS> mLevels;
+
+  /**
+   * @param time point in time
+   * @return tick of the time point
+   */
+  [[nodiscard]] uint64_t toTick(clock::time_point time) const;
+
+  /**
+   * @brief Links timer into the slot matching its expiration
+   * @param timer timer to be linked
+   */
+  void insert(Timer &timer);
+
+  /**
+   * @brief Moves timers from slot of given level to lower levels
+   * @param level level to cascade
+   * @param index slot to cascade
+   */
+  void cascade(unsigned level, uint64_t index);
+
+public:
+  TimerWheel();
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  ~TimerWheel();
+
+  /**
+   * @brief Arms the timer, rearms it if it is already armed
+   * @param timer timer to be armed
+   * @param delay time after which the timer expires, rounded up to whole milliseconds
+   */
+  void arm(Timer &timer, clock::duration delay);
+
+  /**
+   * @brief Calls callbacks of all timers that expired up to given time
+   * @param now current time
+   */
+  void advance(clock::time_point now);
+
+  /**
+   * @param now current time
+   * @return milliseconds until the wheel has to be advanced again, -1 if there are no timers
+   */
+  [[nodiscard]] int nextTimeout(clock::time_point now) const;
+
+  /**
+   * @return number of armed timers
+   */
+  [[nodiscard]] size_t size() const { return mCount; }
+};
+
+#endif//ISA_PROJECT_TIMERWHEEL_H
@@ -0,0 +1,144 @@
+// Matej Sirovatka, xsirov00
+
+#include "WriteBehindOutput.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+
+WriteBehindOutput::WriteBehindOutput(std::unique_ptr<IOutputWrapper> sink, size_t block_size, size_t blocks,
+                                     BufferPool &buffers, FileIoPool &pool, int key) : mState(std::make_shared<State>()),
+                                                                                       mPool(pool),
+                                                                                       mKey(key) {
+  mOpen = sink->is_open();
+  mState->mSink = std::move(sink);
+  mState->mBlockSize = std::max(block_size, static_cast<size_t>(1));
+  mState->mBlocks = std::max(blocks, static_cast<size_t>(2));
+  if (!mOpen) return;
+
+  mState->mRing = buffers.acquire(mState->mBlocks * mState->mBlockSize);
+  mState->mSizes.resize(mState->mBlocks);
+}
+
+WriteBehindOutput::State::~State() {
+  if (mFd >= 0) close(mFd);
+}
+
+WriteBehindOutput::~WriteBehindOutput() {
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  mState->mCancelled = true;
+}
+
+void WriteBehindOutput::schedule() {
+  State &state = *mState;
+  if (state.mWriting || state.mCancelled || state.mFlushed.has_value()) return;
+  if (state.mProduced == state.mConsumed && !state.mFlushing) return;
+
+  state.mWriting = true;
+  mPool.submit([state = mState, pool = &mPool, key = mKey] { consume(state, *pool, key); });
+}
+
+void WriteBehindOutput::consume(const std::shared_ptr<State> &state, FileIoPool &pool, int key) {
+  bool failed;
+  while (true) {
+    size_t index;
+    {
+      std::lock_guard<std::mutex> lock(state->mMutex);
+      failed = state->mFailed;
+      if (state->mCancelled || (state->mProduced == state->mConsumed && !state->mFlushing)) {
+        state->mWriting = false;
+        return;
+      }
+      // nothing is written after flush, the task keeps running until the sink is flushed
+      if (state->mProduced == state->mConsumed) break;
+      index = state->mConsumed % state->mBlocks;
+    }
+
+    // slot is not reused by the writer until it is counted as consumed
+    if (!failed) {
+      state->mSink->write({state->mRing.data() + index * state->mBlockSize, state->mSizes[index]});
+      failed = !state->mSink->good();
+    }
+
+    bool waiting;
+    {
+      std::lock_guard<std::mutex> lock(state->mMutex);
+      state->mFailed = failed;
+      state->mConsumed++;
+      waiting = state->mWaiting && !state->mCancelled;
+      state->mWaiting = false;
+    }
+    if (waiting) pool.notify(key);
+  }
+
+  // descriptor is either handed to the writer or the file is closed before the writer publishes it
+  int fd = -1;
+  bool flushed;
+  if (state->mKeep) {
+    fd = failed ? -1 : state->mSink->release();
+    flushed = fd >= 0;
+  } else {
+    flushed = !failed && state->mSink->flush();
+  }
+  state->mSink.reset();
+
+  {
+    std::lock_guard<std::mutex> lock(state->mMutex);
+    state->mFd = fd;
+    state->mFailed = !flushed;
+    state->mFlushed = flushed;
+    state->mWriting = false;
+  }
+  pool.notify(key);
+}
+
+bool WriteBehindOutput::write(std::span<const uint8_t> buffer) {
+  // caller rejects longer payloads, slot holds a single block
+  assert(buffer.size() <= mState->mBlockSize);
+  if (!mOpen || buffer.empty()) return true;
+
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  State &state = *mState;
+  if (state.mProduced - state.mConsumed == state.mBlocks) {
+    state.mWaiting = true;
+    schedule();
+    return false;
+  }
+
+  // task reads only the slots counted as produced
+  size_t index = state.mProduced % state.mBlocks;
+  std::memcpy(state.mRing.data() + index * state.mBlockSize, buffer.data(), buffer.size());
+  state.mSizes[index] = buffer.size();
+  state.mProduced++;
+  schedule();
+  return true;
+}
+
+bool WriteBehindOutput::good() const {
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  return mOpen && !mState->mFailed;
+}
+
+void WriteBehindOutput::flush(bool keep) {
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  if (!mOpen) {
+    mState->mFlushed = false;
+    return;
+  }
+  mState->mFlushing = true;
+  mState->mKeep = keep;
+  schedule();
+}
+
+std::optional<bool> WriteBehindOutput::flushed() const {
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  return mState->mFlushed;
+}
+
+int WriteBehindOutput::release() {
+  std::lock_guard<std::mutex> lock(mState->mMutex);
+  return std::exchange(mState->mFd, -1);
+}
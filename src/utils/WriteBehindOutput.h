@@ -0,0 +1,131 @@
+// Matej Sirovatka, xsirov00
+
+#ifndef ISA_PROJECT_WRITEBEHINDOUTPUT_H
+#define ISA_PROJECT_WRITEBEHINDOUTPUT_H
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "BufferPool.h"
+#include "FileIoPool.h"
+#include "IOutputWrapper.h"
+
+/**
+ * @brief Output queueing written blocks into a ring and writing them to its sink on threads of the file io pool,
+ * neither write nor flush ever waits for the disk, writer is notified through the pool once the ring has room
+ * or the flush is done, the sink is used by a single task at a time
+ */
+class WriteBehindOutput {
+  /**
+   * @brief State shared with the task writing behind, outlives the output while the task runs
+   */
+  struct State {
+    std::unique_ptr<IOutputWrapper> mSink;
+    size_t mBlockSize;
+    size_t mBlocks;
+
+    // mBlocks slots of mBlockSize bytes, slot of block i is i % mBlocks
+    BufferPool::Buffer mRing;
+    std::vector<size_t> mSizes;
+
+    std::mutex mMutex;
+    // blocks queued by the writer and written by the task, they only grow
+    size_t mProduced = 0;
+    size_t mConsumed = 0;
+    // sink failed to write some block, the following ones are not written
+    bool mFailed = false;
+    // task writing behind is queued or running
+    bool mWriting = false;
+    // writer found the ring full and has to be notified
+    bool mWaiting = false;
+    // writer asked for flush, nothing is written after it
+    bool mFlushing = false;
+    // descriptor of the sink is kept open after the flush
+    bool mKeep = false;
+    // descriptor kept by the flush until the writer takes it
+    int mFd = -1;
+    // result of the flush once it is done
+    std::optional<bool> mFlushed;
+    // output was destroyed, task stops at the next block
+    bool mCancelled = false;
+
+    ~State();
+  };
+
+  std::shared_ptr<State> mState;
+  bool mOpen;
+  FileIoPool &mPool;
+  int mKey;
+
+  /**
+   * @brief Queues task writing behind unless one is queued already or there is nothing to do, called under the lock
+   */
+  void schedule();
+
+  /**
+   * @brief Body of the task, writes queued blocks and then flushes and closes the sink if asked to
+   * @param state shared state
+   * @param pool pool notifying the writer
+   * @param key key of the writer
+   */
+  static void consume(const std::shared_ptr<State> &state, FileIoPool &pool, int key);
+
+public:
+  /**
+   * @brief WriteBehindOutput constructor
+   * @param sink wrapped output
+   * @param block_size size of the largest single write
+   * @param blocks number of blocks queued before write is refused
+   * @param buffers pool the ring is borrowed from
+   * @param pool threads writing to the sink
+   * @param key key the writer is notified under once the ring has room or the flush is done
+   */
+  WriteBehindOutput(std::unique_ptr<IOutputWrapper> sink, size_t block_size, size_t blocks, BufferPool &buffers,
+                    FileIoPool &pool, int key);
+
+  WriteBehindOutput(const WriteBehindOutput &) = delete;
+  WriteBehindOutput &operator=(const WriteBehindOutput &) = delete;
+
+  /**
+   * @brief stops writing behind, blocks not written yet are dropped, the task still running finishes its block
+   * in the background
+   */
+  ~WriteBehindOutput();
+
+  /**
+   * @brief copies buffer into the ring, never waits
+   * @param buffer data to write, must not be longer than block_size
+   * @return false if the ring is full and nothing was written, the writer is notified once it has room
+   */
+  [[nodiscard]] bool write(std::span<const uint8_t> buffer);
+
+  [[nodiscard]] bool is_open() const { return mOpen; }
+
+  /**
+   * @return false once the task failed to write some block
+   */
+  [[nodiscard]] bool good() const;
+
+  /**
+   * @brief asks for the ring to be written out and the sink flushed and closed, the writer is notified once it is,
+   * nothing can be written afterwards
+   * @param keep whether the descriptor of the sink is kept open for release() instead of being closed
+   */
+  void flush(bool keep);
+
+  /**
+   * @return true if every block was written and flushed successfully, nullopt while the flush is not done
+   */
+  [[nodiscard]] std::optional<bool> flushed() const;
+
+  /**
+   * @brief Takes the descriptor kept by successful flush
+   * @return descriptor of the written file, the caller closes it, -1 if it was not kept
+   */
+  int release();
+};
+
+#endif//ISA_PROJECT_WRITEBEHINDOUTPUT_H
@@ -3,7 +3,12 @@
 #ifndef ISA_PROJECT_UTILS_H
 #define ISA_PROJECT_UTILS_H
 
+#include <csignal>
 #include <iostream>
+#include <thread>
+#include <utility>
+
+#include <pthread.h>
 
 /**
  * @brief Enum representing state of the TFTP protocol
@@ -13,6 +18,22 @@ enum class Mode {
   UPLOAD,
 };
 
+/**
+ * @brief Starts background thread with all signals blocked, so that SIGINT always interrupts the event loop
+ * of the main thread instead of being handled by a helper thread
+ * @param args callable and its arguments, as for std::thread
+ * @return started thread
+ */
+template<typename... Args>
+std::thread startBackgroundThread(Args &&...args) {
+  sigset_t mask, old_mask;
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+  std::thread thread(std::forward<Args>(args)...);
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  return thread;
+}
+
 #ifdef DEBUG_LOG
 #define LOG(x) std::cout << x << std::endl;
 #else
@@ -0,0 +1,135 @@
+// Matej Sirovatka, xsirov00
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../src/tftp/Worker.h"
+
+/**
+ * @brief Datagram arriving from a foreign port in the middle of a download is answered with ERROR 5,
+ * while the download itself goes on and completes with the whole file
+ */
+
+static constexpr size_t DATA_SIZE = 512;
+static constexpr size_t CONTENT_SIZE = 10 * DATA_SIZE + 100;
+static constexpr uint16_t STRAY_AFTER_BLOCK = 3;
+
+static int check(bool condition, const char *message) {
+  if (!condition) std::cerr << "FAIL: " << message << "\n";
+  return condition ? 0 : 1;
+}
+
+static int openSocket() {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  timeval timeout = {2, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+  return fd;
+}
+
+static uint16_t localPort(int fd) {
+  sockaddr_in address = {};
+  socklen_t length = sizeof(address);
+  getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length);
+  return ntohs(address.sin_port);
+}
+
+static void sendAck(int fd, uint16_t block, const sockaddr_in &to) {
+  uint8_t ack[4] = {0, 4, static_cast<uint8_t>(block >> 8), static_cast<uint8_t>(block & 0xff)};
+  sendto(fd, ack, sizeof(ack), 0, reinterpret_cast<const sockaddr *>(&to), sizeof(to));
+}
+
+int main() {
+  char root_template[] = "/tmp/tftp-stray-XXXXXX";
+  std::filesystem::path root = mkdtemp(root_template);
+
+  std::vector<char> content(CONTENT_SIZE);
+  for (size_t i = 0; i < content.size(); i++) content[i] = static_cast<char>(i * 7);
+  std::ofstream(root / "file", std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+
+  // free port for the worker, it is released right before the worker binds it
+  int probe = openSocket();
+  uint16_t port = localPort(probe);
+  close(probe);
+
+  ServerArgs args{};
+  args.mPort = port;
+  args.mRootDir = root;
+
+  TFTP::TransferQueue transfers(0, 0);
+  BlockCache cache(0);
+  BufferPool buffers(1 << 20);
+  GroupCommit commit(false);
+  TFTP::Worker worker(args, transfers, cache, buffers, commit, false);
+  std::thread thread(&TFTP::Worker::run, &worker, nullptr);
+
+  int client = openSocket();
+  int stray = openSocket();
+
+  sockaddr_in server = {};
+  server.sin_family = AF_INET;
+  server.sin_port = htons(port);
+  server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  const char request[] = "\0\1file\0octet";
+  sendto(client, request, sizeof(request), 0, reinterpret_cast<sockaddr *>(&server), sizeof(server));
+
+  int failures = 0;
+  std::vector<char> received;
+  uint16_t expected = 1;
+  bool stray_answered = false;
+  uint8_t buffer[DATA_SIZE + 4];
+
+  while (true) {
+    sockaddr_in from = {};
+    socklen_t from_length = sizeof(from);
+    ssize_t length = recvfrom(client, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&from), &from_length);
+    if (length < 4 || buffer[1] != 3) {
+      failures += check(false, "transfer did not complete");
+      break;
+    }
+
+    uint16_t block = (buffer[2] << 8) | buffer[3];
+    if (block != expected) continue;
+    received.insert(received.end(), buffer + 4, buffer + length);
+    expected++;
+
+    if (block == STRAY_AFTER_BLOCK) {
+      // same ACK the client is about to send, but from a port the transfer does not belong to
+      sendAck(stray, block, from);
+      uint8_t error[DATA_SIZE];
+      ssize_t error_length = recv(stray, error, sizeof(error), 0);
+      stray_answered = error_length >= 4 && error[1] == 5 && error[3] == 5;
+    }
+
+    sendAck(client, block, from);
+    if (static_cast<size_t>(length) < DATA_SIZE + 4) break;
+  }
+
+  failures += check(stray_answered, "stray datagram was not answered with ERROR 5");
+  failures += check(received == content, "downloaded file differs");
+
+  worker.stop();
+  thread.join();
+  close(client);
+  close(stray);
+  std::filesystem::remove_all(root);
+
+  if (failures == 0) std::cerr << "OK\n";
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}